@@ -90,11 +90,16 @@ bool BME280::WriteSettings()
 {
    uint8_t ctrlHum, ctrlMeas, config;
 
+   bool success(true);
+
    CalculateRegisters(ctrlHum, ctrlMeas, config);
 
-   WriteRegister(CTRL_HUM_ADDR, ctrlHum);
-   WriteRegister(CTRL_MEAS_ADDR, ctrlMeas);
-   WriteRegister(CONFIG_ADDR, config);
+   // ctrl_hum only takes effect with the following ctrl_meas write.
+   success &= WriteRegister(CTRL_HUM_ADDR, ctrlHum);
+   success &= WriteRegister(CTRL_MEAS_ADDR, ctrlMeas);
+   success &= WriteRegister(CONFIG_ADDR, config);
+
+   return success;
 }
 
 
@@ -126,6 +131,16 @@ bool BME280::begin
    return success;
 }
 
+/****************************************************************/
+bool BME280::begin
+(
+   const Settings& settings
+)
+{
+   m_settings = settings;
+   return begin();
+}
+
 /****************************************************************/
 void BME280::CalculateRegisters
 (
@@ -182,16 +197,17 @@ bool BME280::ReadTrim()
 /****************************************************************/
 bool BME280::ReadData
 (
-   int32_t data[SENSOR_DATA_LENGTH]
+   int32_t data[SENSOR_DATA_LENGTH],
+   bool startConversion
 )
 {
    bool success;
    uint8_t buffer[SENSOR_DATA_LENGTH];
 
-   // For forced mode we need to write the mode to BME280 register before reading
-   if (m_settings.mode == Mode_Forced)
+   // For forced mode we need to write the mode to BME280 register before reading.
+   if (startConversion && m_settings.mode == Mode_Forced)
    {
-      WriteSettings();
+      trigger();
    }
 
    // Registers are in order. So we can start at the pressure register and read 8 bytes.
@@ -372,6 +388,44 @@ float BME280::hum()
 }
 
 
+/****************************************************************/
+bool BME280::trigger
+(
+)
+{
+   uint8_t ctrlHum, ctrlMeas, config;
+   CalculateRegisters(ctrlHum, ctrlMeas, config);
+
+   // ctrl_meas alone starts the conversion, ctrl_hum and config still hold
+   // what WriteSettings() wrote.
+   ctrlMeas = (ctrlMeas & ~0x03) | Mode_Forced;
+   return WriteRegister(CTRL_MEAS_ADDR, ctrlMeas);
+}
+
+
+/****************************************************************/
+uint32_t BME280::measurementTime
+(
+) const
+{
+   // OSR_X1..OSR_X16 are 1 << (value - 1) samples, OSR_Off none.
+   uint32_t temp = m_settings.tempOSR ? 1 << (m_settings.tempOSR - 1) : 0;
+   uint32_t pres = m_settings.presOSR ? 1 << (m_settings.presOSR - 1) : 0;
+   uint32_t hum = m_settings.humOSR ? 1 << (m_settings.humOSR - 1) : 0;
+
+   uint32_t time = 1250 + 2300 * temp;
+   if (pres)
+   {
+      time += 2300 * pres + 575;
+   }
+   if (hum)
+   {
+      time += 2300 * hum + 575;
+   }
+   return time;
+}
+
+
 /****************************************************************/
 void BME280::read
 (
@@ -381,10 +435,39 @@ void BME280::read
    TempUnit tempUnit,
    PresUnit presUnit
 )
+{
+   ReadCompensated(pressure, temp, humidity, tempUnit, presUnit, true);
+}
+
+
+/****************************************************************/
+void BME280::readResult
+(
+   float& pressure,
+   float& temp,
+   float& humidity,
+   TempUnit tempUnit,
+   PresUnit presUnit
+)
+{
+   ReadCompensated(pressure, temp, humidity, tempUnit, presUnit, false);
+}
+
+
+/****************************************************************/
+void BME280::ReadCompensated
+(
+   float& pressure,
+   float& temp,
+   float& humidity,
+   TempUnit tempUnit,
+   PresUnit presUnit,
+   bool startConversion
+)
 {
    int32_t data[8];
    int32_t t_fine;
-   if(!ReadData(data)){
+   if(!ReadData(data, startConversion)){
       pressure = temp = humidity = NAN;
       return;
    }
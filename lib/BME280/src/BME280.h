@@ -64,6 +64,7 @@ enum PresUnit {
 };
 
 enum OSR {
+   OSR_Off = 0, // measurement skipped, the channel reads 0x80000 (0x8000)
    OSR_X1 =  1,
    OSR_X2 =  2,
    OSR_X4 =  3,
@@ -147,6 +148,12 @@ struct Settings {
    /// Method used to initialize the class.
    bool begin();
 
+   /////////////////////////////////////////////////////////////////
+   /// Method used to initialize the class with new settings, they
+   /// are only written once, by the initialization.
+   bool begin(
+      const Settings& settings);
+
 /*****************************************************************/
 /* ENVIRONMENTAL FUNCTIONS                                       */
 /*****************************************************************/
@@ -176,6 +183,26 @@ struct Settings {
       TempUnit  tempUnit    = TempUnit_Celsius,
       PresUnit  presUnit    = PresUnit_Pa);
 
+   /////////////////////////////////////////////////////////////////
+   /// Start one forced mode conversion and return without waiting
+   /// for it, true if successful.
+   bool   trigger();
+
+   /////////////////////////////////////////////////////////////////
+   /// Worst case duration of one conversion with the current
+   /// oversampling settings in microseconds (data sheet 9.1).
+   uint32_t measurementTime() const;
+
+   /////////////////////////////////////////////////////////////////
+   /// Read the result of the last conversion in the specified unit,
+   /// without starting a new one in forced mode.
+   void   readResult(
+      float&    pressure,
+      float&    temperature,
+      float&    humidity,
+      TempUnit  tempUnit    = TempUnit_Celsius,
+      PresUnit  presUnit    = PresUnit_Pa);
+
 
 /*****************************************************************/
 /* ACCESSOR FUNCTIONS                                            */
@@ -302,9 +329,21 @@ private:
 
    /////////////////////////////////////////////////////////////////
    /// Read the raw data from the BME280 into an array and return
-   /// true if successful.
+   /// true if successful. In forced mode a conversion is started
+   /// first unless startConversion is false.
    bool ReadData(
-      int32_t data[8]);
+      int32_t data[8],
+      bool startConversion = true);
+
+   /////////////////////////////////////////////////////////////////
+   /// Read and compensate all three channels.
+   void ReadCompensated(
+      float&    pressure,
+      float&    temperature,
+      float&    humidity,
+      TempUnit  tempUnit,
+      PresUnit  presUnit,
+      bool      startConversion);
 
    /////////////////////////////////////////////////////////////////
    /// Calculate the temperature from the BME280 raw data and
@@ -53,9 +53,8 @@ bool BME280I2C::WriteRegister
   Wire.beginTransmission(m_bme_280_addr);
   Wire.write(addr);
   Wire.write(data);
-  Wire.endTransmission();
 
-  return true; // TODO: Chech return values from wire calls.
+  return Wire.endTransmission() == 0;
 }
 
 
@@ -69,9 +68,14 @@ bool BME280I2C::ReadRegister
 {
   uint8_t ord(0);
 
+  // Register address and data in one combined transaction: a repeated
+  // start instead of STOP and START saves the bus turnaround.
   Wire.beginTransmission(m_bme_280_addr);
   Wire.write(addr);
-  Wire.endTransmission();
+  if(Wire.endTransmission(false) != 0)
+  {
+    return false;
+  }
 
   Wire.requestFrom(m_bme_280_addr, length);
 
@@ -48,6 +48,16 @@ BME280I2C_BRZO::BME280I2C_BRZO
 }
 
 
+/****************************************************************/
+void BME280I2C_BRZO::setClockRate
+(
+  uint16_t clockRate
+)
+{
+  m_i2c_clock_rate = clockRate;
+}
+
+
 /****************************************************************/
 bool BME280I2C_BRZO::WriteRegister
 (
@@ -74,7 +84,6 @@ bool BME280I2C_BRZO::ReadRegister
     brzo_i2c_start_transaction(m_bme_280_addr, m_i2c_clock_rate);
     brzo_i2c_write(&addr, 1, true);
     brzo_i2c_read(data, length, false);
-    brzo_i2c_end_transaction();
     return (brzo_i2c_end_transaction()==0);
 }
 
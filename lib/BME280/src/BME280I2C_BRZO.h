@@ -52,8 +52,10 @@ public:
       StandbyTime _st = StandbyTime_1000ms,
       Filter _filter  = Filter_Off,
       SpiEnable _se   = SpiEnable_False,
-      uint16_t _cr    = 400
-     ): BME280I2C::Settings(_tosr, _hosr, _posr, _mode, _st, _filter, _se),
+      uint16_t _cr    = 400,
+      uint8_t _addr   = 0x76
+     ): BME280I2C::Settings(_tosr, _hosr, _posr, _mode, _st, _filter, _se,
+                            _addr),
         i2cClockRate(_cr) {}
 
       uint16_t i2cClockRate;
@@ -65,6 +67,11 @@ public:
    BME280I2C_BRZO(
       const Settings& settings = Settings());
 
+   ///////////////////////////////////////////////////////////////
+   /// Bus clock in kHz for the following transactions.
+   void setClockRate(
+      uint16_t clockRate);
+
 
 protected:
 
@@ -0,0 +1,97 @@
+/*
+BME280Spi.cpp
+This code records data from the BME280 sensor and provides an API.
+This file is part of the Arduino BME280 library.
+Copyright (C) 2016  Tyler Glenn
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+This header must be included in any derived code or copies of the code.
+
+Based on the data sheet provided by Bosch for the Bme280 environmental sensor.
+ */
+
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "BME280Spi.h"
+
+// Bit 7 of the control byte selects read (1) or write (0), the other
+// seven are the register address.
+#define BME280_SPI_READ  0x80
+#define BME280_SPI_WRITE 0x7F
+
+
+/****************************************************************/
+BME280Spi::BME280Spi
+(
+  const Settings& settings
+):BME280(settings),
+  m_cs_pin(settings.spiCsPin),
+  m_spi_clock(settings.spiClock)
+{
+}
+
+
+/****************************************************************/
+bool BME280Spi::Initialize()
+{
+  // CS going low once latches the chip into SPI mode until power down
+  digitalWrite(m_cs_pin, HIGH);
+  pinMode(m_cs_pin, OUTPUT);
+  SPI.begin();
+
+  return BME280::Initialize();
+}
+
+
+/****************************************************************/
+bool BME280Spi::WriteRegister
+(
+  uint8_t addr,
+  uint8_t data
+)
+{
+  SPI.beginTransaction(SPISettings(m_spi_clock, MSBFIRST, SPI_MODE0));
+  digitalWrite(m_cs_pin, LOW);
+  SPI.transfer(addr & BME280_SPI_WRITE);
+  SPI.transfer(data);
+  digitalWrite(m_cs_pin, HIGH);
+  SPI.endTransaction();
+
+  return true;
+}
+
+
+/****************************************************************/
+bool BME280Spi::ReadRegister
+(
+  uint8_t addr,
+  uint8_t data[],
+  uint8_t length
+)
+{
+  // One burst: the address auto-increments while CS stays low.
+  SPI.beginTransaction(SPISettings(m_spi_clock, MSBFIRST, SPI_MODE0));
+  digitalWrite(m_cs_pin, LOW);
+  SPI.transfer(addr | BME280_SPI_READ);
+  for(uint8_t i = 0; i < length; ++i)
+  {
+    data[i] = SPI.transfer(0);
+  }
+  digitalWrite(m_cs_pin, HIGH);
+  SPI.endTransaction();
+
+  return true;
+}
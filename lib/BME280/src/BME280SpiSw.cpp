@@ -0,0 +1,118 @@
+/*
+BME280SpiSw.cpp
+This code records data from the BME280 sensor and provides an API.
+This file is part of the Arduino BME280 library.
+Copyright (C) 2016  Tyler Glenn
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+This header must be included in any derived code or copies of the code.
+
+Based on the data sheet provided by Bosch for the Bme280 environmental sensor.
+ */
+
+#include <Arduino.h>
+
+#include "BME280SpiSw.h"
+
+// Bit 7 of the control byte selects read (1) or write (0), the other
+// seven are the register address.
+#define BME280_SPI_READ  0x80
+#define BME280_SPI_WRITE 0x7F
+
+
+/****************************************************************/
+BME280SpiSw::BME280SpiSw
+(
+  const Settings& settings
+):BME280(settings),
+  m_cs_pin(settings.spiCsPin),
+  m_mosi_pin(settings.spiMosiPin),
+  m_miso_pin(settings.spiMisoPin),
+  m_sck_pin(settings.spiSckPin)
+{
+}
+
+
+/****************************************************************/
+bool BME280SpiSw::Initialize()
+{
+  // CS going low once latches the chip into SPI mode until power down
+  digitalWrite(m_cs_pin, HIGH);
+  pinMode(m_cs_pin, OUTPUT);
+  digitalWrite(m_sck_pin, LOW); // mode 0 idles low
+  pinMode(m_sck_pin, OUTPUT);
+  pinMode(m_mosi_pin, OUTPUT);
+  pinMode(m_miso_pin, INPUT);
+
+  return BME280::Initialize();
+}
+
+
+/****************************************************************/
+uint8_t BME280SpiSw::Transfer
+(
+  uint8_t data
+)
+{
+  uint8_t received(0);
+
+  // The chip shifts out on the falling and samples on the rising edge.
+  for(int8_t bit = 7; bit >= 0; --bit)
+  {
+    digitalWrite(m_mosi_pin, (data >> bit) & 1);
+    digitalWrite(m_sck_pin, HIGH);
+    received = (received << 1) | digitalRead(m_miso_pin);
+    digitalWrite(m_sck_pin, LOW);
+  }
+
+  return received;
+}
+
+
+/****************************************************************/
+bool BME280SpiSw::WriteRegister
+(
+  uint8_t addr,
+  uint8_t data
+)
+{
+  digitalWrite(m_cs_pin, LOW);
+  Transfer(addr & BME280_SPI_WRITE);
+  Transfer(data);
+  digitalWrite(m_cs_pin, HIGH);
+
+  return true;
+}
+
+
+/****************************************************************/
+bool BME280SpiSw::ReadRegister
+(
+  uint8_t addr,
+  uint8_t data[],
+  uint8_t length
+)
+{
+  // One burst: the address auto-increments while CS stays low.
+  digitalWrite(m_cs_pin, LOW);
+  Transfer(addr | BME280_SPI_READ);
+  for(uint8_t i = 0; i < length; ++i)
+  {
+    data[i] = Transfer(0);
+  }
+  digitalWrite(m_cs_pin, HIGH);
+
+  return true;
+}
@@ -0,0 +1,262 @@
+//#define IODCLIENT_DEBUG_ON 1
+
+#include "AsyncHttpRequest.hpp"
+#include "HttpRequest.hpp"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+AsyncHttpRequest::AsyncHttpRequest() {
+  _client = NULL;
+  _host = NULL;
+  _port = 0;
+  _reused = false;
+  _state = ASYNC_IDLE;
+  _handler = NULL;
+  _context = NULL;
+  _requestTimeout = ASYNC_REQUEST_TIMEOUT;
+  _responseTimeout = ASYNC_RESPONSE_TIMEOUT;
+  _since = 0;
+  _requestLength = 0;
+  _sent = 0;
+  _code = 0;
+  _lineLength = 0;
+  _remaining = 0;
+  _bodyLength = 0;
+}
+
+void AsyncHttpRequest::onResponse(HttpResponseHandler handler, void *context) {
+  _handler = handler;
+  _context = context;
+}
+
+void AsyncHttpRequest::setTimeouts(uint32_t request, uint32_t response) {
+  _requestTimeout = request;
+  _responseTimeout = response;
+}
+
+bool AsyncHttpRequest::connect() {
+  return _address.isSet() ? _client->connect(_address, _port)
+                          : _client->connect(_host, _port);
+}
+
+bool AsyncHttpRequest::resend() {
+  // once, when the server closed the kept alive connection before the first
+  // byte of a response: it dropped the idle connection and never acted on
+  // the request (a timeout is no reason to send again)
+  if (!_reused) {
+    return false;
+  }
+  _reused = false;
+  _client->stop();
+  if (!connect()) {
+    return false;
+  }
+  _sent = 0;
+  _state = ASYNC_SENDING;
+  _since = millis();
+  return true;
+}
+
+bool AsyncHttpRequest::start(Client &client, const char *host, uint16_t port,
+                             const char *method, const char *path,
+                             const char *authorization,
+                             const char *contentType, const char *ifNoneMatch,
+                             const uint8_t *body, size_t length) {
+  if (busy()) {
+    return false;
+  }
+
+  int n = formatRequestHeader((char *)_request, sizeof(_request), host, port,
+                              method, path, authorization, contentType,
+                              ifNoneMatch, length, true);
+  if (n < 0 || n + length > sizeof(_request)) {
+    return false;
+  }
+  memcpy(_request + n, body, length);
+  _requestLength = n + length;
+  _sent = 0;
+
+  _client = &client;
+  _host = host;
+  _port = port;
+  _reused = _client->connected();
+  if (!_reused && !connect()) {
+    return false;
+  }
+
+  _code = 0;
+  _headers.reset(true);
+  _lineLength = 0;
+  _bodyLength = 0;
+  _state = ASYNC_SENDING;
+  _since = millis();
+  return true;
+}
+
+bool AsyncHttpRequest::readLine() {
+  while (_client->available() > 0) {
+    int c = _client->read();
+    if (c < 0) {
+      return false;
+    }
+    if (c == '\n') {
+      _line[_lineLength] = 0;
+      return true;
+    }
+    if (c != '\r' && _lineLength < sizeof(_line) - 1) {
+      _line[_lineLength++] = c; // overlong lines are truncated
+    }
+  }
+  return false;
+}
+
+void AsyncHttpRequest::readData() {
+  // keeps what fits into _body and drops the rest
+  uint8_t scratch[32];
+  size_t chunk = _client->available();
+  if (_remaining >= 0 && chunk > (size_t)_remaining) {
+    chunk = _remaining;
+  }
+
+  int n;
+  size_t room = sizeof(_body) - 1 - _bodyLength;
+  if (room > 0) {
+    n = _client->read((uint8_t *)_body + _bodyLength, min(chunk, room));
+    _bodyLength += max(n, 0);
+  } else {
+    n = _client->read(scratch, min(chunk, sizeof(scratch)));
+  }
+
+  if (n > 0 && _remaining > 0) {
+    _remaining -= n;
+  }
+  if (_remaining == 0) {
+    if (_state == ASYNC_BODY) {
+      finish(_code);
+    } else {
+      _state = ASYNC_CHUNK_END;
+    }
+  }
+}
+
+void AsyncHttpRequest::onLine() {
+  size_t length = _lineLength;
+  _lineLength = 0;
+
+  switch (_state) {
+  case ASYNC_STATUS:
+    // "HTTP/1.1 200 OK"
+    if (strncmp(_line, "HTTP/1.", 7) != 0) {
+      finish(HTTP_ERROR_NO_RESPONSE);
+      return;
+    }
+    _code = atoi(_line + 9);
+    _state = ASYNC_HEADERS;
+    break;
+
+  case ASYNC_HEADERS:
+    if (length > 0) {
+      _headers.parse(_line);
+      break;
+    }
+    _headers.complete(_code);
+    if (_headers.chunked) {
+      _state = ASYNC_CHUNK_SIZE;
+    } else if (_headers.contentLength == 0) {
+      finish(_code);
+    } else {
+      _remaining = _headers.contentLength; // < 0: until the server closes
+      _state = ASYNC_BODY;
+    }
+    break;
+
+  case ASYNC_CHUNK_SIZE:
+    _remaining = strtol(_line, NULL, 16);
+    _state = _remaining > 0 ? ASYNC_CHUNK_DATA : ASYNC_TRAILER;
+    break;
+
+  case ASYNC_CHUNK_END: // CRLF behind the chunk data
+    _state = ASYNC_CHUNK_SIZE;
+    break;
+
+  case ASYNC_TRAILER:
+    if (length == 0) {
+      finish(_code); // the connection is clean for the next request
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+void AsyncHttpRequest::finish(int code) {
+  bool untilClose = _state == ASYNC_BODY && _headers.contentLength < 0;
+  _state = ASYNC_IDLE;
+  _body[_bodyLength] = 0;
+
+  if (code < 0 || _headers.serverCloses || untilClose) {
+    _client->stop();
+  }
+
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("Async request done: ");
+  Serial.println(code);
+#endif
+
+  if (_handler != NULL) {
+    HttpResponse response = {code, _headers, _body, _bodyLength};
+    _handler(response, _context); // may start() the next request
+  }
+}
+
+bool AsyncHttpRequest::poll() {
+  if (_state == ASYNC_SENDING) {
+    if (!_client->connected()) {
+      if (!resend()) {
+        finish(HTTP_ERROR_SEND_FAILED);
+      }
+      return busy();
+    }
+
+    size_t room = _client->availableForWrite();
+    if (room > 0) {
+      _sent += _client->write(_request + _sent,
+                              min(room, _requestLength - _sent));
+    }
+
+    if (_sent == _requestLength) {
+      _state = ASYNC_STATUS;
+      _since = millis();
+    } else if (millis() - _since > _requestTimeout) {
+      finish(HTTP_ERROR_SEND_FAILED);
+    }
+    return busy();
+  }
+  if (_state == ASYNC_IDLE) {
+    return false;
+  }
+
+  while (_state > ASYNC_SENDING && _client->available() > 0) {
+    if (_state == ASYNC_BODY || _state == ASYNC_CHUNK_DATA) {
+      readData();
+    } else if (readLine()) {
+      onLine();
+    }
+  }
+  if (_state <= ASYNC_SENDING) {
+    return busy(); // done, or the handler started the next request
+  }
+
+  if (!_client->connected()) {
+    if (_state == ASYNC_BODY && _remaining < 0) {
+      finish(_code); // the body ends with the connection
+    } else if (_state != ASYNC_STATUS || _lineLength > 0 || !resend()) {
+      finish(HTTP_ERROR_NO_RESPONSE);
+    }
+  } else if (millis() - _since > _responseTimeout) {
+    finish(HTTP_ERROR_NO_RESPONSE);
+  }
+
+  return busy();
+}
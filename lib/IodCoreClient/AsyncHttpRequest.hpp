@@ -0,0 +1,91 @@
+#ifndef ASYNC_HTTP_REQUEST
+#define ASYNC_HTTP_REQUEST
+
+#include "HttpRequest.hpp"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define ASYNC_REQUEST_TIMEOUT 5000   // until the request is written
+#define ASYNC_RESPONSE_TIMEOUT 10000 // from then until the response is read
+#define MAX_ASYNC_REQUEST 1152       // header and body
+#define MAX_ASYNC_RESPONSE 1024      // a config
+
+struct HttpResponse {
+  int code; // HTTP status or one of the HTTP_ERROR_* codes
+  HttpHeaders &headers;
+  char *body; // terminated, truncated to MAX_ASYNC_RESPONSE - 1
+  size_t length;
+};
+
+typedef void (*HttpResponseHandler)(HttpResponse &response, void *context);
+
+enum AsyncHttpState {
+  ASYNC_IDLE,
+  ASYNC_SENDING,
+  ASYNC_STATUS,
+  ASYNC_HEADERS,
+  ASYNC_BODY,
+  ASYNC_CHUNK_SIZE,
+  ASYNC_CHUNK_DATA,
+  ASYNC_CHUNK_END,
+  ASYNC_TRAILER
+};
+
+// One HTTP/1.1 request at a time without blocking: start() queues it and
+// every poll() writes what the TCP send buffer takes and parses what has
+// arrived, until the handler gets the response or an error. Only the
+// connect itself blocks, and not at all on a kept alive connection.
+class AsyncHttpRequest {
+private:
+  Client *_client;
+  const char *_host;
+  uint16_t _port;
+  IPAddress _address;
+  bool _reused; // sent over a kept alive connection
+  AsyncHttpState _state;
+  HttpResponseHandler _handler;
+  void *_context;
+  uint32_t _requestTimeout;
+  uint32_t _responseTimeout;
+  unsigned long _since; // start of the current timeout
+
+  uint8_t _request[MAX_ASYNC_REQUEST];
+  size_t _requestLength;
+  size_t _sent;
+
+  int _code;
+  HttpHeaders _headers;
+  char _line[MAX_RESPONSE_LINE];
+  size_t _lineLength;
+  long _remaining; // of the body or chunk, < 0 until the server closes
+  char _body[MAX_ASYNC_RESPONSE];
+  size_t _bodyLength;
+
+  bool connect();
+  bool resend();
+  bool readLine();
+  void readData();
+  void onLine();
+  void finish(int code);
+
+public:
+  AsyncHttpRequest();
+
+  void onResponse(HttpResponseHandler handler, void *context);
+  void setTimeouts(uint32_t request, uint32_t response);
+  // skips the DNS lookup of the next start()
+  void setAddress(IPAddress address) { _address = address; }
+
+  // Connects unless the client still has a kept alive connection and
+  // queues the request. false if busy, if the request does not fit or the
+  // connection failed, the handler is not called then.
+  bool start(Client &client, const char *host, uint16_t port,
+             const char *method, const char *path, const char *authorization,
+             const char *contentType, const char *ifNoneMatch,
+             const uint8_t *body, size_t length);
+  // call often, returns true while the request is in flight
+  bool poll();
+  bool busy() { return _state != ASYNC_IDLE; }
+};
+
+#endif
@@ -1,87 +1,381 @@
+//#define IODCLIENT_DEBUG_ON 1
+
 #include "BME280Handler.hpp"
-#include "IodCoreClient.hpp"
+#include "LightSleep.hpp"
+#include "SensorDriver.hpp"
+#include "SensorReadings.hpp"
 #include <ArduinoJson.h>
 #include <BME280I2C.h>
+#include <BME280I2C_BRZO.h>
+#include <BME280Spi.h>
+#include <BME280SpiSw.h>
 #include <EnvironmentCalculations.h>
 #include <Wire.h>
-#define IODCLIENT_DEBUG_ON 1
 
-BME280I2C bme;
+// one sensor per I2C address, asleep until the first trigger()
+BME280I2C bmeWire[MAX_BME280] = {
+    BME280I2C::Settings(BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1,
+                        BME280::Mode_Sleep, BME280::StandbyTime_1000ms,
+                        BME280::Filter_Off, BME280::SpiEnable_False,
+                        BME280_ADDRESS),
+    BME280I2C::Settings(BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1,
+                        BME280::Mode_Sleep, BME280::StandbyTime_1000ms,
+                        BME280::Filter_Off, BME280::SpiEnable_False,
+                        BME280_ADDRESS + 1),
+};
+#ifdef USING_BRZO
+BME280I2C_BRZO bmeBrzo[MAX_BME280] = {
+    BME280I2C_BRZO::Settings(BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1,
+                             BME280::Mode_Sleep, BME280::StandbyTime_1000ms,
+                             BME280::Filter_Off, BME280::SpiEnable_False, 400,
+                             BME280_ADDRESS),
+    BME280I2C_BRZO::Settings(BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1,
+                             BME280::Mode_Sleep, BME280::StandbyTime_1000ms,
+                             BME280::Filter_Off, BME280::SpiEnable_False, 400,
+                             BME280_ADDRESS + 1),
+};
+#endif
 
-void addEntry(JsonBuffer &jsonBuffer, JsonObject &sensorData, const char *t,
-              String v) {
-  sensorData[t] = v;
-#ifdef IODCLIENT_DEBUG_ON
-  Serial.println("Adding entry");
+// by position in "bme280Sensors", NULL where an entry was unusable
+static BME280 *bmes[MAX_BME280] = {&bmeWire[0]};
+static uint8_t bmeCount = 1;
+// the channels each one was set up to convert, 0 before its begin()
+static uint32_t bmeChannels[MAX_BME280];
+
+// the pins are only known once the config is loaded
+static BME280 &spiBME280(uint8_t cs, uint32_t clock) {
+  static BME280Spi sensor(BME280Spi::Settings(
+      cs, BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1, BME280::Mode_Sleep,
+      BME280::StandbyTime_1000ms, BME280::Filter_Off, BME280::SpiEnable_False,
+      clock));
+  return sensor;
+}
+
+static BME280 &spiSwBME280(uint8_t cs, uint8_t mosi, uint8_t miso,
+                           uint8_t sck) {
+  static BME280SpiSw sensor(BME280SpiSw::Settings(
+      cs, mosi, miso, sck, BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1,
+      BME280::Mode_Sleep));
+  return sensor;
+}
+
+static BME280 *i2cBME280(uint8_t address, bool brzo) {
+  if (address < BME280_ADDRESS || address >= BME280_ADDRESS + MAX_BME280) {
+    return NULL;
+  }
+
+  uint8_t i = address - BME280_ADDRESS;
+  for (uint8_t n = 0; n < bmeCount; n++) {
+    if (bmes[n] == &bmeWire[i]) {
+      return NULL; // two entries for one sensor
+    }
+#ifdef USING_BRZO
+    if (bmes[n] == &bmeBrzo[i]) {
+      return NULL;
+    }
+#endif
+  }
+
+#ifdef USING_BRZO
+  if (brzo) {
+    return &bmeBrzo[i];
+  }
 #endif
+  return &bmeWire[i];
 }
 
-void handleBME280(IoDCoreClient *client, JsonBuffer &jsonBuffer,
-                  JsonObject &sensorData, JsonArray &activeSensors,
-                  JsonArray &activeFeatures) {
+static uint8_t pinOr(JsonObject &config, const char *key, uint8_t pin) {
+  return config.containsKey(key) ? config[key].as<uint8_t>() : pin;
+}
+
+static void setupI2CSensors(JsonArray &list, bool brzo) {
+  if (list.size() == 0) {
+    bmes[0] = i2cBME280(BME280_ADDRESS, brzo);
+    bmeCount = 1;
+    return;
+  }
 
-  if (client->hasKey(&activeSensors, "BME280_TEMP")     //
-      || client->hasKey(&activeSensors, "BME280_HYGRO") //
-      || client->hasKey(&activeSensors, "BME280_BARO")  //
-      || client->hasKey(&activeSensors, "BME280_ALTI")  //
-      || client->hasKey(&activeSensors, "BME280_DEW")) {
+  for (uint8_t n = 0; n < list.size() && n < MAX_BME280; n++) {
+    JsonObject &entry = list[n];
+    bmes[n] = i2cBME280(entry.containsKey("address")
+                            ? entry["address"].as<uint8_t>()
+                            : BME280_ADDRESS,
+                        brzo);
+    bmeCount = n + 1;
 
-    while (!bme.begin()) {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println("Could not find BME280 sensor!");
+    if (bmes[n] == NULL) {
+      Serial.println(String("Ignoring BME280 entry ") + n);
+    }
+#endif
+  }
+}
+
+uint32_t bme280SpiPins(JsonObject &config) {
+  const char *bus = config["bme280Bus"].as<const char *>();
+  if (bus == NULL) {
+    return 0;
+  }
+
+  uint32_t pins = bit(pinOr(config, "spiCsPin", SPI_CS_PIN));
+  if (strcmp(bus, "spi") == 0) {
+    return pins | bit(SPI_MOSI_PIN) | bit(SPI_MISO_PIN) | bit(SPI_SCK_PIN);
+  }
+  if (strcmp(bus, "spiSw") == 0) {
+    return pins | bit(pinOr(config, "spiMosiPin", SPI_MOSI_PIN)) |
+           bit(pinOr(config, "spiMisoPin", SPI_MISO_PIN)) |
+           bit(pinOr(config, "spiSckPin", SPI_SCK_PIN));
+  }
+  return 0;
+}
+
+static void setupBME280Bus(JsonObject &config) {
+  uint32_t clock = config.containsKey("i2cClockHz")
+                       ? config["i2cClockHz"].as<uint32_t>()
+                       : I2C_CLOCK_HZ;
+  Wire.setClock(clock); // the power domain probes use Wire as well
+
+  const char *bus = config["bme280Bus"].as<const char *>();
+  JsonArray &list = config["bme280Sensors"];
+  uint8_t cs = pinOr(config, "spiCsPin", SPI_CS_PIN);
+  bmeCount = 0;
+  bmes[0] = NULL;
+  memset(bmeChannels, 0, sizeof(bmeChannels));
+  if (bus != NULL && strcmp(bus, "spi") == 0) {
+    bmes[0] = &spiBME280(cs, config.containsKey("spiClockHz")
+                                 ? config["spiClockHz"].as<uint32_t>()
+                                 : SPI_CLOCK_HZ);
+    bmeCount = 1;
+  } else if (bus != NULL && strcmp(bus, "spiSw") == 0) {
+    bmes[0] = &spiSwBME280(cs, pinOr(config, "spiMosiPin", SPI_MOSI_PIN),
+                           pinOr(config, "spiMisoPin", SPI_MISO_PIN),
+                           pinOr(config, "spiSckPin", SPI_SCK_PIN));
+    bmeCount = 1;
+  } else {
+    bool brzo = false;
+#ifdef USING_BRZO
+    const char *backend = config["i2cBackend"].as<const char *>();
+    brzo = backend != NULL && strcmp(backend, "brzo") == 0;
+    for (uint8_t i = 0; i < MAX_BME280; i++) {
+      bmeBrzo[i].setClockRate(clock / 1000);
+    }
 #endif
+    setupI2CSensors(list, brzo);
+  }
 
-      delay(1000);
+  for (uint8_t n = 0; n < bmeCount && n < list.size(); n++) {
+    JsonObject &entry = list[n];
+    if (entry.containsKey("prefix") &&
+        !setBME280Prefix(n, entry["prefix"].as<char *>())) {
+#ifdef IODCLIENT_DEBUG_ON
+      Serial.println(String("Unusable BME280 prefix ") + n);
+#endif
     }
+  }
+}
+
+void addEntry(SensorReadings &readings, uint8_t id, float v) {
+  readings.add(id, v);
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.println("Adding entry");
+#endif
+}
+
+// the due channels of the n-th BME280, as bits of its SENSOR_BME280_*
+static uint32_t dueChannels(uint32_t due, uint8_t n) {
+  return (due >> (n * BME280_CHANNELS)) & BME280_CHANNEL_BITS;
+}
+
+// Starts a forced conversion of just the channels needed of the n-th
+// BME280. The oversampling goes out with its begin(), later conversions of
+// the same channels only write ctrl_meas.
+static bool triggerBME280(uint8_t n, uint32_t channels) {
+  BME280 &bme = *bmes[n];
+
+  if (bmeChannels[n] != channels) {
+    // temperature is always needed, it compensates the other channels
+    bool needsHum = channels & (SENSOR_BIT(SENSOR_BME280_HYGRO) |
+                                SENSOR_BIT(SENSOR_BME280_DEW));
+    bool needsPres = channels & (SENSOR_BIT(SENSOR_BME280_BARO) |
+                                 SENSOR_BIT(SENSOR_BME280_ALTI));
+    BME280::Settings settings(
+        BME280::OSR_X1, needsHum ? BME280::OSR_X1 : BME280::OSR_Off,
+        needsPres ? BME280::OSR_X1 : BME280::OSR_Off, BME280::Mode_Sleep);
 
+    if (bmeChannels[n] != 0) {
+      bme.setSettings(settings);
+    } else {
+      uint8_t attempts = 1;
+      while (!bme.begin(settings)) {
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Reading Sensors");
+        Serial.println("Could not find BME280 sensor!");
 #endif
+        if (attempts++ >= BME280_BEGIN_ATTEMPTS) {
+          return false;
+        }
+        waitMillis(1000);
+      }
+    }
+    bmeChannels[n] = channels;
+  }
+
+  return bme.trigger();
+}
+
+BME280Driver bme280Driver;
+
+BME280Driver::BME280Driver() {
+  _due = 0;
+  _triggered = 0;
+  _readyAt = 0;
+  for (uint8_t n = 0; n < MAX_BME280; n++) {
+    _temp[n] = _hum[n] = _pres[n] = NAN;
+  }
+}
+
+uint32_t BME280Driver::sensors() {
+  uint32_t sensors = 0;
+  for (uint8_t n = 0; n < bmeCount; n++) {
+    if (bmes[n] != NULL) {
+      sensors |= BME280_CHANNEL_BITS << (n * BME280_CHANNELS);
+    }
+  }
+  return sensors;
+}
+
+void BME280Driver::begin(JsonObject &config) { setupBME280Bus(config); }
+
+bool BME280Driver::trigger(uint32_t due) {
+  uint32_t conversionMicros = 0;
+  _due = due;
+  _triggered = 0;
+
+  // the conversions overlap, the wait only has to cover the slowest one
+  for (uint8_t n = 0; n < bmeCount; n++) {
+    uint32_t channels = dueChannels(due, n);
+    if (channels == 0 || bmes[n] == NULL) {
+      continue;
+    }
+    if (triggerBME280(n, channels)) {
+      _triggered |= 1 << n;
+      conversionMicros = max(conversionMicros, bmes[n]->measurementTime());
+    }
+  }
+
+  _readyAt = uptimeMillis() + (conversionMicros + 999) / 1000;
+  return _triggered != 0;
+}
 
-    bool metric = true;
+void BME280Driver::read() {
+  // unit: B000 = Pa,  B001 = hPa,  B010 = Hg,    B011 = atm,
+  //       B100 = bar, B101 = torr, B110 = N/m^2, B111 = psi
+  for (uint8_t n = 0; n < bmeCount; n++) {
+    if (!(_triggered & (1 << n))) {
+      continue;
+    }
 
-    float pres = NAN;
-    float temp = NAN;
-    float hum = NAN;
-    float alt = NAN;
+#ifdef IODCLIENT_DEBUG_ON
+    unsigned long start = micros();
+#endif
+    bmes[n]->readResult(_pres[n], _temp[n], _hum[n], BME280::TempUnit_Celsius,
+                        BME280::PresUnit_hPa);
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.print("BME280 read took ");
+    Serial.print(micros() - start);
+    Serial.println(" us");
+#endif
+  }
+}
 
-    // unit: B000 = Pa,  B001 = hPa,  B010 = Hg,    B011 = atm,
-    //       B100 = bar, B101 = torr, B110 = N/m^2, B111 = psi
-    bme.read(pres, temp, hum, BME280::TempUnit_Celsius, BME280::PresUnit_hPa);
+void BME280Driver::encode(SensorReadings &readings) {
+  bool metric = true;
 
-    if (client->hasKey(&activeFeatures, "I2C_DEVICE_ON_IO13") ||
-        client->hasKey(&activeFeatures, "I2C_DEVICE_ON_IO0")) {
-      delay(50); // read twice if the feature is set, otherwise we get bogus
-                 // values
-      bme.read(pres, temp, hum, BME280::TempUnit_Celsius, BME280::PresUnit_hPa);
+  for (uint8_t n = 0; n < bmeCount; n++) {
+    if (!(_triggered & (1 << n))) {
+      continue;
     }
+    uint32_t channels = dueChannels(_due, n);
+    float temp = _temp[n];
+    float hum = _hum[n];
+    float pres = _pres[n];
 
     // BME280_TEMP: { id: "BME280_TEMP", icon: "thermometer-half", descr:
     // "Thermometer" },
-    if (client->hasKey(&activeSensors, "BME280_TEMP")) {
-      addEntry(jsonBuffer, sensorData, "BME280_TEMP", String(temp));
+    if (channels & SENSOR_BIT(SENSOR_BME280_TEMP)) {
+      addEntry(readings, BME280_SENSOR(n, SENSOR_BME280_TEMP), temp);
     }
     // BME280_HYGRO: { id: "BME280_HYGRO", icon: "tint", descr: "Hygrometer" }
-    if (client->hasKey(&activeSensors, "BME280_HYGRO")) {
-      addEntry(jsonBuffer, sensorData, "BME280_HYGRO", String(hum));
+    if (channels & SENSOR_BIT(SENSOR_BME280_HYGRO)) {
+      addEntry(readings, BME280_SENSOR(n, SENSOR_BME280_HYGRO), hum);
     }
     // BME280_BARO: { id: "BME280_BARO", icon: "cloud", descr: "Barometer" }
-    if (client->hasKey(&activeSensors, "BME280_BARO")) {
-      addEntry(jsonBuffer, sensorData, "BME280_BARO", String(pres));
+    if (channels & SENSOR_BIT(SENSOR_BME280_BARO)) {
+      addEntry(readings, BME280_SENSOR(n, SENSOR_BME280_BARO), pres);
     }
     // BME280_ALTI: { id: "BME280_ALTI", icon: "arrows-v", descr: "Altimeter" }
-    if (client->hasKey(&activeSensors, "BME280_ALTI")) {
+    if (channels & SENSOR_BIT(SENSOR_BME280_ALTI)) {
       // Using ISA standards, the defaults for pressure and temperature at sea
       // level are 101,325 Pa and 288 K.
-      addEntry(
-          jsonBuffer, sensorData, "BME280_ALTI",
-          String(EnvironmentCalculations::Altitude(pres, metric, 1013.25)));
+      addEntry(readings, BME280_SENSOR(n, SENSOR_BME280_ALTI),
+               EnvironmentCalculations::Altitude(pres, metric, 1013.25));
     }
     // BME280_DEW: { id: "BME280_DEW", icon: "filter", descr: "Dewpoint" }
-    if (client->hasKey(&activeSensors, "BME280_DEW")) {
-      addEntry(jsonBuffer, sensorData, "BME280_DEW",
-               String(EnvironmentCalculations::DewPoint(temp, hum, metric)));
+    if (channels & SENSOR_BIT(SENSOR_BME280_DEW)) {
+      addEntry(readings, BME280_SENSOR(n, SENSOR_BME280_DEW),
+               EnvironmentCalculations::DewPoint(temp, hum, metric));
     }
   }
-  return;
-}
\ No newline at end of file
+}
+
+static BME280::StandbyTime standbyTime(uint16_t millis) {
+  // the longest standby that does not exceed the requested one
+  if (millis >= 1000) {
+    return BME280::StandbyTime_1000ms;
+  } else if (millis >= 250) {
+    return BME280::StandbyTime_250ms;
+  } else if (millis >= 125) {
+    return BME280::StandbyTime_125ms;
+  } else if (millis >= 63) {
+    return BME280::StandbyTime_62500us;
+  } else if (millis >= 50) {
+    return BME280::StandbyTime_50ms;
+  } else if (millis >= 20) {
+    return BME280::StandbyTime_20ms;
+  } else if (millis >= 10) {
+    return BME280::StandbyTime_10ms;
+  }
+  return BME280::StandbyTime_500us;
+}
+
+static BME280::Filter filterCoefficient(uint8_t filter) {
+  if (filter >= 16) {
+    return BME280::Filter_16;
+  } else if (filter >= 8) {
+    return BME280::Filter_8;
+  } else if (filter >= 4) {
+    return BME280::Filter_4;
+  } else if (filter >= 2) {
+    return BME280::Filter_2;
+  }
+  return BME280::Filter_Off;
+}
+
+bool startBME280Normal(uint16_t standbyMillis, uint8_t filter) {
+  BME280::Settings settings(BME280::OSR_X1, BME280::OSR_X1, BME280::OSR_X1,
+                            BME280::Mode_Normal, standbyTime(standbyMillis),
+                            filterCoefficient(filter));
+  if (bmes[0] == NULL || !bmes[0]->begin(settings)) {
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.println("Could not find BME280 sensor!");
+#endif
+    return false;
+  }
+  bmeChannels[0] = 0; // a forced trigger has to set it up again
+  return true;
+}
+
+void readBME280(float &temp, float &hum, float &pres) {
+  // once per sample tick, one burst read of the latest conversion
+  bmes[0]->read(pres, temp, hum, BME280::TempUnit_Celsius,
+                BME280::PresUnit_hPa);
+}
@@ -1,11 +1,63 @@
 #ifndef BME280HANDLER
 #define BME280HANDLER
 
+#include "SensorDriver.hpp"
+#include "SensorReadings.hpp"
 #include <ArduinoJson.h>
-#include <IodCoreClient.hpp>
 
-void handleBME280(IoDCoreClient *client, JsonBuffer &jsonBuffer,
-                  JsonObject &sensorData, JsonArray &activeSensors,
-                  JsonArray &activeFeatures);
+#define BME280_ADDRESS 0x76 // SDO to GND, 0x77 with SDO to VDDIO
+#define BME280_BEGIN_ATTEMPTS 3 // a second apart
+#define BME280_CHANNEL_BITS                                                    \
+  (((1UL << BME280_CHANNELS) - 1) << SENSOR_BME280_TEMP)
+#define I2C_CLOCK_HZ 400000 // fast mode, "i2cClockHz" lowers it for long wires
+#define SPI_CLOCK_HZ 10000000 // the BME280 maximum
+#define SPI_CS_PIN 15   // the HSPI pins, "spi*Pin" in the config move them
+#define SPI_MOSI_PIN 13 // (for "spiSw", "spi" only moves CS)
+#define SPI_MISO_PIN 12
+#define SPI_SCK_PIN 14
+
+// The BME280s. Their bus comes from "bme280Bus": "i2c" (default), "spi" for
+// the hardware SPI at "spiClockHz" or "spiSw" for bit-banged SPI on any
+// pins. I2C runs at "i2cClockHz", over brzo_i2c with "i2cBackend": "brzo"
+// when built with USING_BRZO.
+//
+// On I2C the optional "bme280Sensors" array lists up to MAX_BME280 sensors,
+// e.g. [{"address": 118}, {"address": 119, "prefix": "OUTDOOR"}]. The n-th
+// one reports as BME280_SENSOR(n, ...) and is named "<prefix>_TEMP" etc.,
+// "BME280" and "BME280_2" by default. SPI has one sensor, only the prefix
+// of the first entry applies.
+//
+// Only the due channels are converted, and a sensor that does not answer is
+// left out.
+class BME280Driver : public SensorDriver {
+private:
+  uint32_t _due;
+  uint8_t _triggered; // bit n: the n-th BME280 is converting
+  uint32_t _readyAt;
+  float _temp[MAX_BME280];
+  float _hum[MAX_BME280];
+  float _pres[MAX_BME280];
+
+public:
+  BME280Driver();
+
+  uint32_t sensors();
+  void begin(JsonObject &config);
+  bool trigger(uint32_t due);
+  uint32_t readyAt() { return _readyAt; }
+  void read();
+  void encode(SensorReadings &readings);
+};
+
+extern BME280Driver bme280Driver;
+
+// the GPIOs (bit n for GPIOn) of the SPI bus the config asks for, 0 on I2C
+uint32_t bme280SpiPins(JsonObject &config);
+
+// Continuous mode: the first BME280 free-runs in normal mode with the given
+// standby time and IIR filter coefficient (0, 2, 4, 8 or 16), reads then
+// return its latest conversion without waiting.
+bool startBME280Normal(uint16_t standbyMillis, uint8_t filter);
+void readBME280(float &temp, float &hum, float &pres);
 
 #endif
\ No newline at end of file
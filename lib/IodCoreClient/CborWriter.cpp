@@ -0,0 +1,97 @@
+#include "CborWriter.hpp"
+#include "FixedPoint.hpp"
+#include <Arduino.h>
+
+#define CBOR_UINT 0
+#define CBOR_NEGINT 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+#define CBOR_NULL 0xf6
+
+#define CBOR_TAG_DECIMAL_FRACTION 4
+
+CborWriter::CborWriter(uint8_t *buf, size_t capacity) {
+  _buf = buf;
+  _capacity = capacity;
+  _size = 0;
+  _overflowed = false;
+}
+
+void CborWriter::put(uint8_t b) {
+  if (_size < _capacity) {
+    _buf[_size++] = b;
+  } else {
+    _overflowed = true;
+  }
+}
+
+void CborWriter::writeHead(uint8_t major, uint32_t value) {
+  major <<= 5;
+  if (value < 24) {
+    put(major | value);
+  } else if (value <= 0xff) {
+    put(major | 24);
+    put(value);
+  } else if (value <= 0xffff) {
+    put(major | 25);
+    put(value >> 8);
+    put(value);
+  } else {
+    put(major | 26);
+    put(value >> 24);
+    put(value >> 16);
+    put(value >> 8);
+    put(value);
+  }
+}
+
+void CborWriter::writeMap(size_t entries) { writeHead(CBOR_MAP, entries); }
+
+void CborWriter::writeArray(size_t items) { writeHead(CBOR_ARRAY, items); }
+
+void CborWriter::writeTag(uint32_t tag) { writeHead(CBOR_TAG, tag); }
+
+void CborWriter::writeUInt(uint32_t value) { writeHead(CBOR_UINT, value); }
+
+void CborWriter::writeInt(int32_t value) {
+  if (value < 0) {
+    writeHead(CBOR_NEGINT, (uint32_t)(-1 - value));
+  } else {
+    writeHead(CBOR_UINT, value);
+  }
+}
+
+void CborWriter::writeText(const char *text) {
+  size_t len = strlen(text);
+  writeHead(CBOR_TEXT, len);
+  for (size_t i = 0; i < len; i++) {
+    put(text[i]);
+  }
+}
+
+void CborWriter::writeNull() { put(CBOR_NULL); }
+
+void CborWriter::writeDecimal(float value, uint8_t decimals) {
+  int32_t mantissa;
+
+  if (decimals > MAX_DECIMALS) {
+    decimals = MAX_DECIMALS;
+  }
+
+  if (!toFixed(value, decimals, mantissa)) {
+    writeNull(); // sensor did not deliver a (sane) value
+    return;
+  }
+
+  if (decimals == 0) {
+    writeInt(mantissa);
+  } else {
+    // decimal fraction: [exponent, mantissa], e.g. 23.45 -> [-2, 2345]
+    writeTag(CBOR_TAG_DECIMAL_FRACTION);
+    writeArray(2);
+    writeInt(-decimals);
+    writeInt(mantissa);
+  }
+}
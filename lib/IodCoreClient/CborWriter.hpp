@@ -0,0 +1,36 @@
+#ifndef CBOR_WRITER
+#define CBOR_WRITER
+
+#include <Arduino.h>
+
+// Minimal streaming CBOR (RFC 7049) encoder, writes directly into a fixed
+// buffer without building an object tree first.
+class CborWriter {
+private:
+  uint8_t *_buf;
+  size_t _capacity;
+  size_t _size;
+  bool _overflowed;
+
+  void put(uint8_t b);
+  void writeHead(uint8_t major, uint32_t value);
+
+public:
+  CborWriter(uint8_t *buf, size_t capacity);
+
+  void writeMap(size_t entries);
+  void writeArray(size_t items);
+  void writeTag(uint32_t tag);
+  void writeUInt(uint32_t value);
+  void writeInt(int32_t value);
+  void writeText(const char *text);
+  void writeNull();
+
+  // fixed-point value, as decimal fraction (tag 4) if decimals > 0
+  void writeDecimal(float value, uint8_t decimals);
+
+  size_t size() { return _size; }
+  bool overflowed() { return _overflowed; }
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "CoapClient.hpp"
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#define COAP_VERSION 0x40 // version 1 in the top two bits
+#define COAP_CON 0
+#define COAP_NON 1
+#define COAP_ACK 2
+#define COAP_RST 3
+#define COAP_POST 0x02
+#define COAP_PAYLOAD_MARKER 0xff
+
+#define COAP_OPTION_ETAG 4
+#define COAP_OPTION_URI_PATH 11
+#define COAP_OPTION_CONTENT_FORMAT 12
+#define COAP_OPTION_URI_QUERY 15
+
+// internal results of parseResponse
+#define COAP_IGNORE -100
+#define COAP_EMPTY_ACK -101
+
+static uint8_t optionNibble(uint16_t value, uint8_t *ext, size_t &extLength) {
+  if (value < 13) {
+    return value;
+  } else if (value < 269) {
+    ext[extLength++] = value - 13;
+    return 13;
+  } else {
+    ext[extLength++] = (value - 269) >> 8;
+    ext[extLength++] = value - 269;
+    return 14;
+  }
+}
+
+static size_t putOption(uint8_t *msg, size_t room, uint16_t &last,
+                        uint16_t number, const uint8_t *value, size_t length) {
+  uint8_t ext[4];
+  size_t extLength = 0;
+  uint8_t delta = optionNibble(number - last, ext, extLength);
+  uint8_t len = optionNibble(length, ext, extLength);
+
+  if (1 + extLength + length > room) {
+    return 0;
+  }
+
+  last = number;
+  msg[0] = (delta << 4) | len;
+  memcpy(msg + 1, ext, extLength);
+  memcpy(msg + 1 + extLength, value, length);
+  return 1 + extLength + length;
+}
+
+static bool readOptionValue(uint8_t nibble, const uint8_t *msg, size_t length,
+                            size_t &pos, uint16_t &value) {
+  if (nibble == 13) {
+    if (pos + 1 > length) {
+      return false;
+    }
+    value = msg[pos++] + 13;
+  } else if (nibble == 14) {
+    if (pos + 2 > length) {
+      return false;
+    }
+    value = ((msg[pos] << 8) | msg[pos + 1]) + 269;
+    pos += 2;
+  } else {
+    value = nibble; // 15 is reserved, the length check below catches it
+  }
+  return true;
+}
+
+CoapClient::CoapClient(UDP &udp, uint16_t messageId) : _udp(udp) {
+  _messageId = messageId;
+  _retransmits = COAP_MAX_RETRANSMIT;
+  _etag[0] = 0;
+  _payloadLength = 0;
+}
+
+size_t CoapClient::buildRequest(uint8_t *msg, const char *path,
+                                const char *query, uint16_t contentFormat,
+                                const char *etag, const uint8_t *payload,
+                                size_t length) {
+  size_t n = 0;
+  size_t added;
+  uint16_t last = 0;
+
+  msg[n++] = COAP_VERSION | (COAP_CON << 4) | sizeof(_token);
+  msg[n++] = COAP_POST;
+  msg[n++] = _messageId >> 8;
+  msg[n++] = _messageId;
+  memcpy(msg + n, _token, sizeof(_token));
+  n += sizeof(_token);
+
+  // options have to be sorted by their number
+  size_t etagLength = etag != NULL ? strlen(etag) : 0;
+  if (etagLength > 0 && etagLength <= MAX_COAP_ETAG) {
+    added = putOption(msg + n, MAX_COAP_REQUEST - n, last, COAP_OPTION_ETAG,
+                      (const uint8_t *)etag, etagLength);
+    if (added == 0) {
+      return 0;
+    }
+    n += added;
+  }
+
+  const char *segment = path;
+  while (*segment != 0) {
+    const char *end = strchr(segment, '/');
+    size_t segmentLength = end != NULL ? end - segment : strlen(segment);
+    added = putOption(msg + n, MAX_COAP_REQUEST - n, last,
+                      COAP_OPTION_URI_PATH, (const uint8_t *)segment,
+                      segmentLength);
+    if (added == 0) {
+      return 0;
+    }
+    n += added;
+    segment += segmentLength + (end != NULL ? 1 : 0);
+  }
+
+  uint8_t format = contentFormat;
+  added = putOption(msg + n, MAX_COAP_REQUEST - n, last,
+                    COAP_OPTION_CONTENT_FORMAT, &format, 1);
+  if (added == 0) {
+    return 0;
+  }
+  n += added;
+
+  if (query != NULL) {
+    added = putOption(msg + n, MAX_COAP_REQUEST - n, last,
+                      COAP_OPTION_URI_QUERY, (const uint8_t *)query,
+                      strlen(query));
+    if (added == 0) {
+      return 0;
+    }
+    n += added;
+  }
+
+  if (length > 0) {
+    if (n + 1 + length > MAX_COAP_REQUEST) {
+      return 0;
+    }
+    msg[n++] = COAP_PAYLOAD_MARKER;
+    memcpy(msg + n, payload, length);
+    n += length;
+  }
+
+  return n;
+}
+
+void CoapClient::sendEmptyAck(uint16_t messageId) {
+  uint8_t ack[4] = {COAP_VERSION | (COAP_ACK << 4), 0,
+                    (uint8_t)(messageId >> 8), (uint8_t)messageId};
+  _udp.beginPacket(_udp.remoteIP(), _udp.remotePort());
+  _udp.write(ack, sizeof(ack));
+  _udp.endPacket();
+}
+
+int CoapClient::parseResponse(uint8_t *msg, size_t length, char *response) {
+  if (length < 4 || (msg[0] & 0xc0) != COAP_VERSION) {
+    return COAP_IGNORE;
+  }
+
+  uint8_t type = (msg[0] >> 4) & 0x03;
+  uint8_t tokenLength = msg[0] & 0x0f;
+  uint8_t code = msg[1];
+  uint16_t messageId = (msg[2] << 8) | msg[3];
+  bool tokenMatches = tokenLength == sizeof(_token) &&
+                      length >= 4u + tokenLength &&
+                      memcmp(msg + 4, _token, sizeof(_token)) == 0;
+
+  if (type == COAP_RST && messageId == _messageId) {
+    return COAP_ERROR_RESET;
+  }
+  if (type == COAP_ACK && messageId == _messageId && code == 0) {
+    return COAP_EMPTY_ACK; // the response will follow separately
+  }
+  if (code == 0 || !tokenMatches ||
+      (type == COAP_ACK && messageId != _messageId)) {
+    return COAP_IGNORE;
+  }
+  if (type == COAP_CON) {
+    sendEmptyAck(messageId); // separate response
+  }
+
+  size_t pos = 4 + tokenLength;
+  uint16_t number = 0;
+  while (pos < length && msg[pos] != COAP_PAYLOAD_MARKER) {
+    uint8_t header = msg[pos++];
+    uint16_t delta, optionLength;
+    if (!readOptionValue(header >> 4, msg, length, pos, delta) ||
+        !readOptionValue(header & 0x0f, msg, length, pos, optionLength) ||
+        pos + optionLength > length) {
+      return COAP_IGNORE; // malformed
+    }
+    number += delta;
+
+    if (number == COAP_OPTION_ETAG && optionLength <= MAX_COAP_ETAG) {
+      memcpy(_etag, msg + pos, optionLength);
+      _etag[optionLength] = 0;
+    }
+    pos += optionLength;
+  }
+
+  _payloadLength = 0;
+  if (pos < length && msg[pos] == COAP_PAYLOAD_MARKER) {
+    pos++;
+    _payloadLength = length - pos;
+    memmove(response, msg + pos, _payloadLength);
+  }
+  response[_payloadLength] = 0;
+
+  return (code >> 5) * 100 + (code & 0x1f);
+}
+
+int CoapClient::post(const char *host, uint16_t port, const char *path,
+                     const char *query, uint16_t contentFormat,
+                     const char *etag, const uint8_t *payload, size_t length,
+                     char *response, size_t responseSize) {
+  uint8_t request[MAX_COAP_REQUEST];
+
+  _etag[0] = 0;
+  _payloadLength = 0;
+  response[0] = 0;
+  for (uint8_t i = 0; i < sizeof(_token); i++) {
+    _token[i] = random(256);
+  }
+
+  size_t n = buildRequest(request, path, query, contentFormat, etag, payload,
+                          length);
+  if (n == 0) {
+    return COAP_ERROR_SEND_FAILED;
+  }
+
+  // ACK_TIMEOUT * random(1, ACK_RANDOM_FACTOR = 1.5), doubled each time
+  unsigned long timeout = COAP_ACK_TIMEOUT + random(COAP_ACK_TIMEOUT / 2);
+  bool acked = false;
+
+  for (uint8_t attempt = 0; attempt <= _retransmits; attempt++) {
+    if (!acked) {
+      int ready = _address.isSet() ? _udp.beginPacket(_address, port)
+                                   : _udp.beginPacket(host, port);
+      if (!ready || _udp.write(request, n) != n || !_udp.endPacket()) {
+        return COAP_ERROR_SEND_FAILED;
+      }
+    }
+
+    unsigned long start = millis();
+    while (millis() - start < timeout) {
+      if (_udp.parsePacket() <= 0) {
+        delay(1);
+        continue;
+      }
+
+      int size = _udp.read((uint8_t *)response, responseSize - 1);
+      int code = parseResponse((uint8_t *)response, max(size, 0), response);
+      if (code == COAP_EMPTY_ACK) {
+        acked = true; // stop retransmitting, keep waiting
+      } else if (code != COAP_IGNORE) {
+        _messageId++;
+        return code;
+      }
+    }
+
+    timeout *= 2;
+  }
+
+  _messageId++;
+  return COAP_ERROR_TIMEOUT;
+}
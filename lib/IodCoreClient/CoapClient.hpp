@@ -0,0 +1,58 @@
+#ifndef COAP_CLIENT
+#define COAP_CLIENT
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+
+#define COAP_ACK_TIMEOUT 2000 // RFC 7252 defaults
+#define COAP_MAX_RETRANSMIT 4
+#define MAX_COAP_REQUEST 320
+#define MAX_COAP_ETAG 8
+
+#define COAP_CONTENT_JSON 50
+#define COAP_CONTENT_CBOR 60
+
+#define COAP_ERROR_SEND_FAILED -1
+#define COAP_ERROR_TIMEOUT -3
+#define COAP_ERROR_RESET -5
+
+// Minimal CoAP (RFC 7252) client: one confirmable POST with exponential
+// back-off retransmission, response piggybacked or separate. The response
+// has to fit into a single datagram (no block-wise transfer).
+class CoapClient {
+private:
+  UDP &_udp;
+  IPAddress _address;
+  uint16_t _messageId;
+  uint8_t _token[4];
+  uint8_t _retransmits;
+  char _etag[MAX_COAP_ETAG + 1];
+  size_t _payloadLength;
+
+  size_t buildRequest(uint8_t *msg, const char *path, const char *query,
+                      uint16_t contentFormat, const char *etag,
+                      const uint8_t *payload, size_t length);
+  int parseResponse(uint8_t *msg, size_t length, char *response);
+  void sendEmptyAck(uint16_t messageId);
+
+public:
+  CoapClient(UDP &udp, uint16_t messageId);
+
+  void setRetransmits(uint8_t retransmits) { _retransmits = retransmits; }
+  // skips the DNS lookup of host in post()
+  void setAddress(IPAddress address) { _address = address; }
+
+  // POSTs payload to the "/"-separated path. The response payload is copied
+  // into response (terminated, must hold responseSize bytes) and the code is
+  // returned as class * 100 + detail, e.g. 204 for 2.04 Changed, or < 0.
+  int post(const char *host, uint16_t port, const char *path,
+           const char *query, uint16_t contentFormat, const char *etag,
+           const uint8_t *payload, size_t length, char *response,
+           size_t responseSize);
+
+  uint16_t messageId() { return _messageId; }
+  size_t payloadLength() { return _payloadLength; }
+  const char *etag() { return _etag; }
+};
+
+#endif
@@ -0,0 +1,130 @@
+//#define IODCLIENT_DEBUG_ON 1
+
+#include "ContinuousMode.hpp"
+#include "BME280Handler.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <EnvironmentCalculations.h>
+
+ContinuousMode::ContinuousMode() {
+  _active = 0;
+  _ticks = 0;
+  _sampledTicks = 0;
+  _samplePeriod = DEFAULT_SAMPLE_PERIOD_MILLIS;
+  _uploadPeriod = DEFAULT_UPLOAD_PERIOD_MILLIS;
+  _standby = 0;
+  _filter = 0;
+  _windowStart = 0;
+}
+
+bool ContinuousMode::isEnabled(JsonObject &config) {
+  return String(config["mode"].as<char *>()).equals("continuous");
+}
+
+void ContinuousMode::load(JsonObject &config, JsonArray &activeSensors) {
+  _active = 0;
+  for (uint8_t i = 0; i < activeSensors.size(); i++) {
+    uint8_t id = sensorId(activeSensors.get<char *>(i));
+    if (id != SENSOR_UNKNOWN) {
+      _active |= SENSOR_BIT(id);
+    }
+  }
+
+  if (config.containsKey("samplePeriodMillis")) {
+    _samplePeriod = max(config["samplePeriodMillis"].as<uint16_t>(),
+                        (uint16_t)MIN_SAMPLE_PERIOD_MILLIS);
+  }
+  if (config.containsKey("uploadPeriodMillis")) {
+    _uploadPeriod = max(config["uploadPeriodMillis"].as<uint32_t>(),
+                        (uint32_t)_samplePeriod);
+  }
+  _standby = config["bme280StandbyMillis"].as<uint16_t>();
+  _filter = config["bme280Filter"].as<uint8_t>();
+}
+
+bool ContinuousMode::begin() {
+  if (!startBME280Normal(_standby, _filter)) {
+    return false;
+  }
+
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("Continuous mode, sampling every ");
+  Serial.print(_samplePeriod);
+  Serial.print(" ms, uploading every ");
+  Serial.print(_uploadPeriod);
+  Serial.println(" ms");
+#endif
+
+  _window.reset();
+  _windowStart = millis();
+  _sampledTicks = _ticks;
+  _ticker.attach_ms(_samplePeriod, tick, this);
+  return true;
+}
+
+void ContinuousMode::tick(ContinuousMode *self) {
+  // timer (SYS) context: no I2C here, collect() reads from loop()
+  self->_ticks++;
+}
+
+void ContinuousMode::add(Sample &sample) {
+  bool metric = true;
+
+  _window.samples++;
+  if (_active & SENSOR_BIT(SENSOR_BME280_TEMP)) {
+    _window.add(SENSOR_BME280_TEMP, sample.temp);
+  }
+  if (_active & SENSOR_BIT(SENSOR_BME280_HYGRO)) {
+    _window.add(SENSOR_BME280_HYGRO, sample.hum);
+  }
+  if (_active & SENSOR_BIT(SENSOR_BME280_BARO)) {
+    _window.add(SENSOR_BME280_BARO, sample.pres);
+  }
+  if (_active & SENSOR_BIT(SENSOR_BME280_ALTI)) {
+    _window.add(SENSOR_BME280_ALTI, EnvironmentCalculations::Altitude(
+                                        sample.pres, metric, 1013.25));
+  }
+  if (_active & SENSOR_BIT(SENSOR_BME280_DEW)) {
+    _window.add(SENSOR_BME280_DEW, EnvironmentCalculations::DewPoint(
+                                       sample.temp, sample.hum, metric));
+  }
+}
+
+bool ContinuousMode::collect() {
+  uint32_t ticks = _ticks;
+  if (ticks != _sampledTicks) {
+    // the sensor only has its latest conversion, older ticks are lost
+    _window.dropped += ticks - _sampledTicks - 1;
+    _sampledTicks = ticks;
+
+    Sample sample;
+    readBME280(sample.temp, sample.hum, sample.pres);
+    add(sample);
+  }
+  return millis() - _windowStart >= _uploadPeriod;
+}
+
+void ContinuousMode::nextWindow() {
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("Window of ");
+  Serial.print(_window.samples);
+  Serial.print(" samples, ");
+  Serial.print(_window.dropped);
+  Serial.println(" dropped");
+#endif
+
+  if (_windows.push(_window)) {
+    _window.reset();
+  } else {
+    // the uploader is more than a queue behind, the next window reports
+    // this one's samples as dropped
+    uint32_t lost = _window.samples + _window.dropped;
+    _window.reset();
+    _window.dropped = lost;
+  }
+  // a fixed cadence, a slow upload does not shift the following windows
+  _windowStart += _uploadPeriod;
+  if (millis() - _windowStart >= _uploadPeriod) {
+    _windowStart = millis(); // fell behind by more than a window
+  }
+}
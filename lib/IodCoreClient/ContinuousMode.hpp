@@ -0,0 +1,65 @@
+#ifndef CONTINUOUS_MODE
+#define CONTINUOUS_MODE
+
+#include "RingBuffer.hpp"
+#include "WindowStats.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Ticker.h>
+
+#define DEFAULT_SAMPLE_PERIOD_MILLIS 100
+#define MIN_SAMPLE_PERIOD_MILLIS 10
+#define DEFAULT_UPLOAD_PERIOD_MILLIS 60000UL
+#define WINDOW_QUEUE_LENGTH 4 // 3 windows while an upload is slow or fails
+
+struct Sample {
+  float temp;
+  float hum;
+  float pres;
+};
+
+// For mains-powered nodes ("mode": "continuous"): the BME280 runs in normal
+// mode and a timer ticks every "samplePeriodMillis". The main loop reads a
+// sample per tick into per-sensor window statistics. Every
+// "uploadPeriodMillis" the window goes into a queue, the uploader takes it
+// from there once the previous upload is done, sampling goes on meanwhile.
+// Ticks the loop was too busy for count as dropped, as do the samples of a
+// window that did not fit into the queue. "bme280StandbyMillis" and
+// "bme280Filter" set up the sensor itself.
+class ContinuousMode {
+private:
+  Ticker _ticker;
+  volatile uint32_t _ticks; // only the timer callback writes it
+  uint32_t _sampledTicks;
+  SensorWindow _window;
+  RingBuffer<SensorWindow, WINDOW_QUEUE_LENGTH> _windows;
+  uint32_t _active; // SENSOR_BIT()s
+  uint16_t _samplePeriod;
+  uint32_t _uploadPeriod;
+  uint16_t _standby;
+  uint8_t _filter;
+  unsigned long _windowStart;
+
+  static void tick(ContinuousMode *self);
+  void add(Sample &sample);
+
+public:
+  ContinuousMode();
+
+  static bool isEnabled(JsonObject &config);
+  void load(JsonObject &config, JsonArray &activeSensors);
+  bool begin();
+
+  // reads the sample that is due, true once the window is complete
+  bool collect();
+  SensorWindow &window() { return _window; }
+  // queues the complete window and starts the next one
+  void nextWindow();
+
+  // uploader side: the oldest complete window, NULL if there is none. It
+  // stays queued until windowSent().
+  SensorWindow *queuedWindow() { return _windows.front(); }
+  void windowSent() { _windows.pop(); }
+};
+
+#endif
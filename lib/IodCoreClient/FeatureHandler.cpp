@@ -1,33 +1,22 @@
 
 #include "FeatureHandler.hpp"
 #include "IodCoreClient.hpp"
+#include "PowerDomains.hpp"
+#include "WakeTelemetry.hpp"
 #include <ArduinoJson.h>
-void handleFeaturesBeforeSensors(IoDCoreClient *client, JsonBuffer &jsonBuffer,
-                                 JsonArray &activeFeatures) {
 
-  if (client->hasKey(&activeFeatures, "I2C_DEVICE_ON_IO13")) {
-    pinMode(13, OUTPUT);
-    digitalWrite(13, HIGH); // provide 3V3
-    delay(200);             // give sensor(s) some time to startup
-  }
+PowerDomains powerDomains;
 
-  if (client->hasKey(&activeFeatures, "I2C_DEVICE_ON_IO0")) {
-    pinMode(0, OUTPUT);
-    digitalWrite(0, HIGH); // provide 3V3
-    delay(200);             // give sensor(s) some time to startup
-  }
+void handleFeaturesBeforeSensors(IoDCoreClient *client, JsonObject &config,
+                                 JsonArray &activeFeatures) {
+  // provide 3V3 and give the sensor(s) the time they need to start up
+  powerDomains.load(config, activeFeatures);
+  phaseStart(PHASE_POWER_UP);
+  powerDomains.powerUp();
+  phaseEnd(PHASE_POWER_UP);
 }
 
-void handleFeaturesAfterSensors(IoDCoreClient *client, JsonBuffer &jsonBuffer,
+void handleFeaturesAfterSensors(IoDCoreClient *client, JsonObject &config,
                                 JsonArray &activeFeatures) {
-
-  if (client->hasKey(&activeFeatures, "I2C_DEVICE_ON_IO13")) {
-    pinMode(13, OUTPUT);
-    digitalWrite(13, LOW); // remove 3V3
-  }
-
-  if (client->hasKey(&activeFeatures, "I2C_DEVICE_ON_IO0")) {
-    pinMode(0, OUTPUT);
-    digitalWrite(0, LOW); // remove 3V3
-  }
-}
\ No newline at end of file
+  powerDomains.powerDown(); // remove 3V3
+}
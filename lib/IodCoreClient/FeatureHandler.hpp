@@ -4,9 +4,9 @@
 #include "IodCoreClient.hpp"
 #include <ArduinoJson.h>
 
-void handleFeaturesBeforeSensors(IoDCoreClient *client, JsonBuffer &jsonBuffer,
+void handleFeaturesBeforeSensors(IoDCoreClient *client, JsonObject &config,
                                  JsonArray &activeFeatures);
 
-void handleFeaturesAfterSensors(IoDCoreClient *client, JsonBuffer &jsonBuffer,
+void handleFeaturesAfterSensors(IoDCoreClient *client, JsonObject &config,
                                 JsonArray &activeFeatures);
 #endif
\ No newline at end of file
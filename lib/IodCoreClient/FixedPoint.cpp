@@ -0,0 +1,60 @@
+#include "FixedPoint.hpp"
+#include <Arduino.h>
+
+static const float decimalScale[MAX_DECIMALS + 1] = {
+    1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f, 1000000.0f};
+
+bool toFixed(float value, uint8_t decimals, int32_t &mantissa) {
+  if (isnan(value) || isinf(value)) {
+    return false;
+  }
+
+  if (decimals > MAX_DECIMALS) {
+    decimals = MAX_DECIMALS;
+  }
+
+  float scaled = value * decimalScale[decimals];
+  if (scaled >= 2147483647.0f || scaled <= -2147483647.0f) {
+    return false;
+  }
+
+  mantissa = (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+  return true;
+}
+
+size_t formatFixed(char *buf, float value, uint8_t decimals) {
+  int32_t mantissa;
+
+  if (decimals > MAX_DECIMALS) {
+    decimals = MAX_DECIMALS;
+  }
+
+  if (!toFixed(value, decimals, mantissa)) {
+    strcpy(buf, isnan(value) ? "nan" : "ovf");
+    return 3;
+  }
+
+  // render the digits backwards, then copy them in the right order
+  char digits[MAX_FIXED_LENGTH];
+  uint8_t n = 0;
+  uint32_t u = mantissa < 0 ? (uint32_t)(-(int64_t)mantissa) : mantissa;
+
+  do {
+    digits[n++] = '0' + u % 10;
+    u /= 10;
+  } while (u > 0 || n <= decimals); // at least one digit before the '.'
+
+  size_t len = 0;
+  if (mantissa < 0) {
+    buf[len++] = '-';
+  }
+  while (n > 0) {
+    if (n == decimals) {
+      buf[len++] = '.';
+    }
+    buf[len++] = digits[--n];
+  }
+  buf[len] = 0;
+
+  return len;
+}
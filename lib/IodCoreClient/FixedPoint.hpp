@@ -0,0 +1,18 @@
+#ifndef FIXED_POINT
+#define FIXED_POINT
+
+#include <Arduino.h>
+
+#define MAX_DECIMALS 6
+#define MAX_FIXED_LENGTH 16 // "-2147483.648000" + terminator
+
+// Scales value by 10^decimals and rounds half away from zero (like dtostrf).
+// Returns false for nan/inf or if the result does not fit into 32 bits.
+bool toFixed(float value, uint8_t decimals, int32_t &mantissa);
+
+// Writes value with the given number of decimals into buf (at least
+// MAX_FIXED_LENGTH bytes) using integer math only, returns the length.
+// Prints "nan" / "ovf" like Arduino's Print does.
+size_t formatFixed(char *buf, float value, uint8_t decimals);
+
+#endif
@@ -0,0 +1,323 @@
+#include "HttpRequest.hpp"
+#include "WakeTelemetry.hpp"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+size_t base64Encode(const uint8_t *in, size_t length, char *out) {
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t n = 0;
+
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t triple = (uint32_t)in[i] << 16;
+    if (i + 1 < length) {
+      triple |= (uint32_t)in[i + 1] << 8;
+    }
+    if (i + 2 < length) {
+      triple |= in[i + 2];
+    }
+
+    out[n++] = alphabet[(triple >> 18) & 0x3f];
+    out[n++] = alphabet[(triple >> 12) & 0x3f];
+    out[n++] = i + 1 < length ? alphabet[(triple >> 6) & 0x3f] : '=';
+    out[n++] = i + 2 < length ? alphabet[triple & 0x3f] : '=';
+  }
+  out[n] = 0;
+
+  return n;
+}
+
+uint32_t parseHttpDate(const char *date) {
+  static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  char month[4];
+  int day, year, hour, minute, second;
+
+  const char *comma = strchr(date, ',');
+  if (comma == NULL ||
+      sscanf(comma + 1, "%d %3s %d %d:%d:%d", &day, month, &year, &hour,
+             &minute, &second) != 6 ||
+      year < 1970) {
+    return 0;
+  }
+  const char *found = strstr(months, month);
+  if (found == NULL || strlen(month) != 3) {
+    return 0;
+  }
+  int m = (found - months) / 3 + 1;
+
+  // days since 1970-01-01 of a proleptic Gregorian date, the year is
+  // counted from March so that the leap day comes last
+  int y = year - (m <= 2 ? 1 : 0);
+  int era = y / 400;
+  int yearOfEra = y - era * 400;
+  int dayOfYear = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int dayOfEra =
+      yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  uint32_t days = era * 146097 + dayOfEra - 719468;
+
+  return days * 86400UL + hour * 3600UL + minute * 60UL + second;
+}
+
+int formatRequestHeader(char *header, size_t size, const char *host,
+                        uint16_t port, const char *method, const char *path,
+                        const char *authorization, const char *contentType,
+                        const char *ifNoneMatch, size_t length,
+                        bool keepAlive) {
+  int n = snprintf(header, size,
+                   "%s %s HTTP/1.1\r\n"
+                   "Host: %s:%u\r\n"
+                   "Authorization: Basic %s\r\n"
+                   "Connection: %s\r\n"
+                   "Content-Length: %u\r\n",
+                   method, path, host, port, authorization,
+                   keepAlive ? "keep-alive" : "close", (unsigned)length);
+
+  if (contentType != NULL && n < (int)size) {
+    n += snprintf(header + n, size - n, "Content-Type: %s\r\n", contentType);
+  }
+  if (ifNoneMatch != NULL && ifNoneMatch[0] != 0 && n < (int)size) {
+    n += snprintf(header + n, size - n, "If-None-Match: %s\r\n", ifNoneMatch);
+  }
+  if (n < (int)size) {
+    n += snprintf(header + n, size - n, "\r\n");
+  }
+
+  return n < (int)size ? n : -1;
+}
+
+void HttpHeaders::reset(bool keepAlive) {
+  contentLength = -1;
+  chunked = false;
+  etag[0] = 0;
+  date = 0;
+  retryAfter = 0;
+  serverCloses = !keepAlive;
+  retryAt = 0;
+}
+
+void HttpHeaders::parse(char *line) {
+  char *value = strchr(line, ':');
+  if (value == NULL) {
+    return;
+  }
+  *value++ = 0;
+  while (*value == ' ') {
+    value++;
+  }
+
+  if (strcasecmp(line, "Content-Length") == 0) {
+    contentLength = atol(value);
+  } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+    chunked = strcasecmp(value, "chunked") == 0;
+  } else if (strcasecmp(line, "ETag") == 0) {
+    strncpy(etag, value, MAX_ETAG_LEN - 1);
+    etag[MAX_ETAG_LEN - 1] = 0;
+  } else if (strcasecmp(line, "Date") == 0) {
+    date = parseHttpDate(value);
+  } else if (strcasecmp(line, "Connection") == 0) {
+    serverCloses = serverCloses || strcasecmp(value, "close") == 0;
+  } else if (strcasecmp(line, "Retry-After") == 0) {
+    // delay-seconds or an HTTP-date
+    if (isdigit(value[0])) {
+      retryAfter = strtoul(value, NULL, 10);
+    } else {
+      retryAt = parseHttpDate(value);
+    }
+  }
+}
+
+void HttpHeaders::complete(int code) {
+  if (code == HTTP_NO_CONTENT || code == HTTP_NOT_MODIFIED) {
+    contentLength = 0; // never have a body, even without Content-Length
+    chunked = false;
+  }
+  if (retryAt != 0 && date != 0 && retryAt > date) {
+    retryAfter = retryAt - date;
+  }
+}
+
+HttpRequest::HttpRequest(Client &client) : _client(client) {
+  _headers.reset(true);
+  _keepAlive = false;
+  _bodyRead = false;
+  _timedOut = false;
+}
+
+int HttpRequest::readByte() {
+  unsigned long start = millis();
+  while (!_client.available()) {
+    if (!_client.connected()) {
+      return -1;
+    }
+    if (millis() - start > HTTP_TIMEOUT) {
+      _timedOut = true;
+      return -1;
+    }
+    delay(1);
+  }
+  return _client.read();
+}
+
+int HttpRequest::readLine(char *line, size_t size) {
+  size_t length = 0;
+  int c;
+
+  while ((c = readByte()) >= 0) {
+    if (c == '\n') {
+      line[length] = 0;
+      return length;
+    }
+    if (c != '\r' && length < size - 1) {
+      line[length++] = c; // overlong lines are truncated
+    }
+  }
+
+  line[length] = 0;
+  return length > 0 ? length : -1;
+}
+
+size_t HttpRequest::readInto(char *buf, size_t room, long count) {
+  // reads count bytes (or everything until the server closes if count < 0),
+  // keeps the first room bytes and drops the rest
+  size_t stored = 0;
+  uint8_t scratch[32];
+
+  while (count != 0) {
+    unsigned long start = millis();
+    while (!_client.available()) {
+      if (!_client.connected() || millis() - start > HTTP_TIMEOUT) {
+        return stored;
+      }
+      delay(1);
+    }
+
+    size_t chunk = _client.available();
+    if (count > 0 && chunk > (size_t)count) {
+      chunk = count;
+    }
+
+    int n;
+    if (stored < room) {
+      n = _client.read((uint8_t *)buf + stored, min(chunk, room - stored));
+      stored += max(n, 0);
+    } else {
+      n = _client.read(scratch, min(chunk, sizeof(scratch)));
+    }
+
+    if (n <= 0) {
+      return stored;
+    }
+    if (count > 0) {
+      count -= n;
+    }
+  }
+
+  return stored;
+}
+
+int HttpRequest::send(const char *host, uint16_t port, const char *method,
+                      const char *path, const char *authorization,
+                      const char *contentType, const char *ifNoneMatch,
+                      const uint8_t *body, size_t length) {
+  _headers.reset(_keepAlive);
+  _bodyRead = false;
+  _timedOut = false;
+
+  phaseStart(PHASE_REQUEST);
+  bool reused = _keepAlive && _client.connected();
+  if (!reused) {
+    bool connected = _address.isSet() ? _client.connect(_address, port)
+                                       : _client.connect(host, port);
+    if (!connected) {
+      phaseEnd(PHASE_REQUEST);
+      return HTTP_ERROR_CONNECTION_FAILED;
+    }
+  }
+
+  char header[MAX_REQUEST_HEADER];
+  int n = formatRequestHeader(header, sizeof(header), host, port, method, path,
+                              authorization, contentType, ifNoneMatch, length,
+                              _keepAlive);
+  if (n < 0) {
+    close();
+    phaseEnd(PHASE_REQUEST);
+    return HTTP_ERROR_CONNECTION_FAILED; // should never happen
+  }
+
+  // one write for the header keeps it in a single segment
+  _client.write((const uint8_t *)header, n);
+  if (length > 0) {
+    _client.write(body, length);
+  }
+  phaseEnd(PHASE_REQUEST);
+
+  char line[MAX_RESPONSE_LINE];
+
+  // "HTTP/1.1 200 OK"
+  phaseStart(PHASE_RESPONSE);
+  int status = readLine(line, sizeof(line));
+  if (status < 0 || strncmp(line, "HTTP/1.", 7) != 0) {
+    close();
+    phaseEnd(PHASE_RESPONSE);
+    if (reused && status < 0 && !_timedOut) {
+      // the server dropped the idle connection meanwhile and never saw the
+      // request, start over. After a timeout it may have processed it, so a
+      // second send could upload the values twice.
+      return send(host, port, method, path, authorization, contentType,
+                  ifNoneMatch, body, length);
+    }
+    return HTTP_ERROR_NO_RESPONSE;
+  }
+  int code = atoi(line + 9);
+
+  while (readLine(line, sizeof(line)) > 0) {
+    _headers.parse(line);
+  }
+  _headers.complete(code);
+  phaseEnd(PHASE_RESPONSE);
+
+  return code;
+}
+
+size_t HttpRequest::readBody(char *buf, size_t size) {
+  size_t length = 0;
+  phaseStart(PHASE_RESPONSE);
+
+  if (_headers.chunked) {
+    char line[16];
+    while (readLine(line, sizeof(line)) >= 0) {
+      long chunk = strtol(line, NULL, 16);
+      if (chunk <= 0) {
+        // last chunk, the trailer lines up to the empty line are still
+        // waiting and would be read as the next status line
+        while (readLine(line, sizeof(line)) > 0) {
+        }
+        break;
+      }
+      length += readInto(buf + length, size - 1 - length, chunk);
+      readLine(line, sizeof(line)); // CRLF behind the chunk data
+    }
+  } else {
+    length = readInto(buf, size - 1, _headers.contentLength);
+  }
+
+  buf[length] = 0;
+  _bodyRead = true;
+  phaseEnd(PHASE_RESPONSE);
+  return length;
+}
+
+void HttpRequest::end() {
+  // without a length the body only ends when the server closes
+  if (_headers.serverCloses ||
+      (!_headers.chunked && _headers.contentLength < 0 && !_bodyRead)) {
+    close();
+    return;
+  }
+  if (!_bodyRead) {
+    char none[1];
+    readBody(none, sizeof(none)); // drops the body, the next response follows
+  }
+}
+
+void HttpRequest::close() { _client.stop(); }
@@ -0,0 +1,98 @@
+#ifndef HTTP_REQUEST
+#define HTTP_REQUEST
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define HTTP_OK 200
+#define HTTP_NO_CONTENT 204
+#define HTTP_NOT_MODIFIED 304
+#define HTTP_NOT_FOUND 404
+#define HTTP_UNSUPPORTED_MEDIA_TYPE 415
+#define HTTP_INTERNAL_SERVER_ERROR 500
+
+#define HTTP_ERROR_CONNECTION_FAILED -1
+#define HTTP_ERROR_SEND_FAILED -3
+#define HTTP_ERROR_NOT_CONNECTED -4
+#define HTTP_ERROR_NO_RESPONSE -11
+
+#define HTTP_TIMEOUT 5000
+#define MAX_REQUEST_HEADER 384
+#define MAX_RESPONSE_LINE 96
+#define MAX_ETAG_LEN 40
+
+// Seconds since 1970 of an IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT"),
+// 0 if it can't be parsed.
+uint32_t parseHttpDate(const char *date);
+
+// Writes the base64 encoding of in to out (4 * ceil(length / 3) + 1 bytes).
+size_t base64Encode(const uint8_t *in, size_t length, char *out);
+
+// Writes the request line and headers up to the empty line, returns the
+// length or -1 if they did not fit.
+int formatRequestHeader(char *header, size_t size, const char *host,
+                        uint16_t port, const char *method, const char *path,
+                        const char *authorization, const char *contentType,
+                        const char *ifNoneMatch, size_t length, bool keepAlive);
+
+// The response headers the clients care about.
+struct HttpHeaders {
+  long contentLength; // -1 if not sent by the server
+  bool chunked;
+  char etag[MAX_ETAG_LEN];
+  uint32_t date;       // Date header, 0 if not sent
+  uint32_t retryAfter; // seconds, 0 if not sent
+  bool serverCloses;   // the response said "Connection: close"
+  uint32_t retryAt;    // Retry-After as an HTTP-date
+
+  void reset(bool keepAlive);
+  // one "Name: value" line, modified in place
+  void parse(char *line);
+  // after the empty line that ends the headers
+  void complete(int code);
+};
+
+// Minimal HTTP/1.1 client, works on fixed buffers only (no String, no heap
+// besides what the TCP stack needs for the connection itself).
+class HttpRequest {
+private:
+  Client &_client;
+  IPAddress _address; // connect here instead of resolving the host
+  HttpHeaders _headers;
+  bool _keepAlive;
+  bool _bodyRead;
+  bool _timedOut; // the last readByte() gave up waiting, not closed
+
+  int readByte();
+  int readLine(char *line, size_t size);
+  size_t readInto(char *buf, size_t room, long count);
+
+public:
+  HttpRequest(Client &client);
+
+  // skips the DNS lookup, host is still sent in the Host header
+  void setAddress(IPAddress address) { _address = address; }
+  // keeps the connection of the client open for the next HttpRequest
+  void setKeepAlive(bool keepAlive) { _keepAlive = keepAlive; }
+
+  // connects (unless a kept alive connection is open), sends the request
+  // and reads the status line and headers. Returns the HTTP status code or
+  // one of the HTTP_ERROR_* codes.
+  int send(const char *host, uint16_t port, const char *method,
+           const char *path, const char *authorization,
+           const char *contentType, const char *ifNoneMatch,
+           const uint8_t *body, size_t length);
+
+  // reads the response body into buf (terminated), returns its length
+  size_t readBody(char *buf, size_t size);
+  // done with the response, closes the connection unless it can be reused
+  void end();
+  void close();
+
+  long contentLength() { return _headers.contentLength; }
+  const char *etag() { return _headers.etag; }
+  uint32_t date() { return _headers.date; }
+  uint32_t retryAfter() { return _headers.retryAfter; }
+};
+
+#endif
@@ -1,30 +1,221 @@
 //#define IODCLIENT_DEBUG_ON 1
 
+#include "HttpRequest.hpp"
 #include "IodCoreClient.hpp"
+#include "LightSleep.hpp"
+#include "PayloadEncoder.hpp"
+#include "WakeTelemetry.hpp"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
-#include <ESP8266HTTPClient.h>
 #include <ESP8266WiFi.h>
 
-// MEMORY MAP
-// 4 bytes magic number [8,1,19,21] to know if we  "have a UUID"
-#define UUID_OFFSET 4
-#define UUID_LEN 16
-// 16 bytes UUID
-#define CONFIG_LEN_OFFSET UUID_OFFSET + 16
-// 4 bytes config length
-#define CONFIG_OFFSET CONFIG_LEN_OFFSET + 4
-// [...] config
+// entries the server updates on every request, they alone are not worth an
+// EEPROM write
+static const char *volatileKeys[] = {"lastSeen"};
+#define VOLATILE_KEY_COUNT (sizeof(volatileKeys) / sizeof(volatileKeys[0]))
+
+static bool isVolatileKey(const char *key) {
+  for (uint8_t i = 0; i < VOLATILE_KEY_COUNT; i++) {
+    if (strcmp(key, volatileKeys[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// deep comparison without copies, member order does not matter
+static bool jsonEquals(const JsonVariant &a, const JsonVariant &b) {
+  if (a.is<JsonObject>()) {
+    if (!b.is<JsonObject>()) {
+      return false;
+    }
+    JsonObject &x = a;
+    JsonObject &y = b;
+    if (x.size() != y.size()) {
+      return false;
+    }
+    for (const JsonPair &pair : x) {
+      if (!y.containsKey(pair.key) ||
+          !jsonEquals(pair.value, y.get<JsonVariant>(pair.key))) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (a.is<JsonArray>()) {
+    if (!b.is<JsonArray>()) {
+      return false;
+    }
+    JsonArray &x = a;
+    JsonArray &y = b;
+    if (x.size() != y.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < x.size(); i++) {
+      if (!jsonEquals(x.get<JsonVariant>(i), y.get<JsonVariant>(i))) {
+        return false;
+      }
+    }
+    return true;
+  }
+  if (a.is<const char *>()) {
+    return b.is<const char *>() &&
+           strcmp(a.as<const char *>(), b.as<const char *>()) == 0;
+  }
+  if (a.is<bool>()) {
+    return b.is<bool>() && a.as<bool>() == b.as<bool>();
+  }
+  if (a.is<long>()) {
+    return b.is<long>() && a.as<long>() == b.as<long>();
+  }
+  if (a.is<double>()) {
+    return b.is<double>() && a.as<double>() == b.as<double>();
+  }
+  // null or undefined
+  return !b.is<JsonObject>() && !b.is<JsonArray>() &&
+         !b.is<const char *>() && !b.is<bool>() && !b.is<double>();
+}
+
+static_assert(sizeof(br_ssl_session_parameters) <= RTC_TLS_SESSION_LEN,
+              "TLS session does not fit into RtcState");
 
 IoDCoreClient::IoDCoreClient(char *wifiSsid, char *wifiPass, char *iodHost,
-                             uint16_t iodPort, char *iodUser, char *iodPass) {
+                             uint16_t iodPort, char *iodUser, char *iodPass,
+                             uint16_t mqttPort, uint16_t coapPort) {
   _wifiSsid = wifiSsid;
   _wifiPass = wifiPass;
   _iodHost = iodHost;
   _iodPort = iodPort;
   _iodUser = iodUser;
   _iodPass = iodPass;
+  _mqttPort = mqttPort;
+  _coapPort = coapPort;
+
+  memset(&_rtc, 0, sizeof(RtcState));
+  _newETag[0] = 0;
+  _nodeId[0] = 0;
+  _jsonArenaPeak = 0;
+  _response[0] = 0;
+  _configBuffer = NULL;
+  _transport = TRANSPORT_HTTP;
+  _mqttCleanSession = false;
+  _coapRetransmits = COAP_MAX_RETRANSMIT;
+  _tls = false;
+  _httpTls = NULL;
+  _deadbands = false;
+  _changed = true;
+  _heartbeat = DEFAULT_HEARTBEAT_MILLIS;
+  _retryAfter = 0;
+  _wakePeriod = 0;
+  _configStored = false;
+  _telemetry = false;
+  _uploadEeprom = NULL;
+  _uploadContentType = JSON_CONTENT_TYPE;
+  _uploadStart = 0;
+  _uploadCode = 0;
+  memset(_periods, 0, sizeof(_periods));
+
+  // the credentials never change, so encode them only once
+  char credentials[MAX_CREDENTIALS_LENGTH];
+  size_t len = snprintf(credentials, sizeof(credentials), "%s:%s", _iodUser,
+                        _iodPass);
+  base64Encode((uint8_t *)credentials, min(len, sizeof(credentials) - 1),
+               _authorization);
+}
+
+void IoDCoreClient::loadState() {
+  if (!loadRtcState(_rtc)) {
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.println("No RTC state, starting fresh");
+#endif
+    // the server may still remember message ids from before the reset
+    _rtc.coapMessageId = ESP.random() & 0xffff;
+    for (uint8_t id = 0; id < SENSOR_COUNT; id++) {
+      _rtc.lastValues[id] = NAN;
+    }
+  }
+  memcpy(_tlsSession.getSession(), _rtc.tlsSession,
+         sizeof(br_ssl_session_parameters));
+  // without RF the radio cannot be in use, waits may light sleep
+  allowLightSleep(!radioEnabled());
+}
+
+uint32_t IoDCoreClient::clockMillis() {
+  return _rtc.clockMillis + uptimeMillis();
+}
+
+void IoDCoreClient::syncClock(uint32_t epoch) {
+  // on average the Date second started half a second before we read it
+  uint32_t now = clockMillis() - 500;
+
+  if (_rtc.driftEpoch == 0 || epoch < _rtc.driftEpoch) {
+    _rtc.driftEpoch = epoch;
+    _rtc.driftClock = now;
+  } else if (now - _rtc.driftClock >= DRIFT_MIN_SPAN) {
+    // the sleep timer is an RC oscillator, its error dominates
+    int64_t nominal = now - _rtc.driftClock;
+    int64_t real = (int64_t)(epoch - _rtc.driftEpoch) * 1000;
+    int32_t ppm = constrain((real - nominal) * 1000000 / nominal,
+                            -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+    // smoothed, a single sample carries up to a second of jitter
+    _rtc.driftPpm = (_rtc.flags & RTC_FLAG_DRIFT_KNOWN)
+                        ? (3 * _rtc.driftPpm + ppm) / 4
+                        : ppm;
+    _rtc.flags |= RTC_FLAG_DRIFT_KNOWN;
+    _rtc.driftEpoch = epoch;
+    _rtc.driftClock = now;
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.print("Clock drift ");
+    Serial.print(ppm);
+    Serial.print(" ppm, learned ");
+    Serial.println(_rtc.driftPpm);
+#endif
+  }
+
+  _rtc.syncEpoch = epoch;
+  _rtc.syncClock = now;
+}
+
+uint64_t IoDCoreClient::epochMillis() {
+  if (_rtc.syncEpoch == 0) {
+    return 0;
+  }
+  int64_t elapsed = clockMillis() - _rtc.syncClock;
+  elapsed += elapsed * _rtc.driftPpm / 1000000;
+  return (uint64_t)_rtc.syncEpoch * 1000 + elapsed;
+}
+
+uint32_t IoDCoreClient::epochNow() { return epochMillis() / 1000; }
+
+void IoDCoreClient::deepSleep(uint64_t micros, RFMode mode) {
+  httpClient().stop();
+  _rtc.clockMillis += uptimeMillis() + micros / 1000;
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("Light slept ");
+  Serial.print(lightSleptMillis());
+  Serial.print(" ms this wake, ~");
+  Serial.print(lightSleepSavedMicroampSeconds());
+  Serial.println(" uAs saved");
+#endif
+  if (mode == WAKE_RF_DISABLED) {
+    _rtc.flags |= RTC_FLAG_RF_OFF;
+  } else {
+    _rtc.flags &= ~RTC_FLAG_RF_OFF;
+  }
+  memcpy(_rtc.tlsSession, _tlsSession.getSession(),
+         sizeof(br_ssl_session_parameters));
+  if (_telemetry) {
+    keepPhaseMillis(_rtc.phaseMillis);
+  } else {
+    memset(_rtc.phaseMillis, 0, sizeof(_rtc.phaseMillis));
+  }
+  saveRtcState(_rtc);
+  ESP.deepSleep(micros, mode);
+}
+
+bool IoDCoreClient::radioEnabled() {
+  return (_rtc.flags & RTC_FLAG_RF_OFF) == 0;
 }
 
 bool IoDCoreClient::hasUUID(EEPROMClass &eeprom) {
@@ -117,76 +308,148 @@ bool IoDCoreClient::hasKey(JsonArray *jsonArray, const char *key) {
   return false;
 }
 
-bool IoDCoreClient::hasChanged(JsonObject &oldObject, JsonObject &newObject,
-                               const char *entry) {
-  if (!oldObject[entry].as<String>().equals(newObject[entry].as<String>())) {
+bool IoDCoreClient::hasChanged(JsonObject &oldObject, JsonObject &newObject) {
+  for (const JsonPair &pair : newObject) {
+    if (isVolatileKey(pair.key)) {
+      continue;
+    }
+    if (!oldObject.containsKey(pair.key) ||
+        !jsonEquals(oldObject.get<JsonVariant>(pair.key), pair.value)) {
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println(String(entry) +
-                   " has changed: " + oldObject[entry].as<String>() + " -> " +
-                   newObject[entry].as<String>());
+      Serial.print(pair.key);
+      Serial.println(" has changed");
 #endif
-    return true;
+      return true;
+    }
+  }
+  // an entry the server dropped falls back to the firmware default
+  for (const JsonPair &pair : oldObject) {
+    if (!isVolatileKey(pair.key) && !newObject.containsKey(pair.key)) {
+#ifdef IODCLIENT_DEBUG_ON
+      Serial.print(pair.key);
+      Serial.println(" was removed");
+#endif
+      return true;
+    }
   }
 
   return false;
 }
 
+JsonArena &IoDCoreClient::jsonArena() { return _jsonArena; }
+
+void IoDCoreClient::resetJsonArena() {
+  _jsonArenaPeak = max(_jsonArenaPeak, _jsonArena.size());
+  _jsonArena.clear();
+}
+
+size_t IoDCoreClient::jsonArenaPeak() {
+  return max(_jsonArenaPeak, _jsonArena.size());
+}
+
+void IoDCoreClient::logJsonArena(const char *phase) {
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("JSON arena after ");
+  Serial.print(phase);
+  Serial.print(": ");
+  Serial.print(_jsonArena.size());
+  Serial.print(" of ");
+  Serial.print(JSON_ARENA_SIZE);
+  Serial.println(" bytes");
+#endif
+}
+
+// serializes a JSON DOM straight into the config area of the EEPROM
+class ConfigWriter : public Print {
+private:
+  EEPROMClass &_eeprom;
+  uint32_t _length;
+
+public:
+  ConfigWriter(EEPROMClass &eeprom) : _eeprom(eeprom), _length(0) {}
+
+  size_t write(uint8_t c) {
+    if (CONFIG_OFFSET + _length >= MAX_CONFIG_SIZE) {
+      return 0;
+    }
+    _eeprom.write(CONFIG_OFFSET + _length++, c);
+    return 1;
+  }
+
+  uint32_t length() { return _length; }
+};
+
 uint8_t IoDCoreClient::storeConfigIfNewer(EEPROMClass &eeprom, char *newConfig,
                                           char *uuidString) {
-  String newConfigString = String(newConfig);
 #ifdef IODCLIENT_DEBUG_ON
-  Serial.println(String("Got new Config:") + newConfigString);
+  Serial.print("Got new Config:");
+  Serial.println(newConfig);
 #endif
 
-  if (newConfigString.indexOf("lastSeen") > 0) { // we have a valid config
-    uint32_t len = this->getConfigLength(eeprom);
-    char oldConfig[len + 1];
+  if (strstr(newConfig, "lastSeen") != NULL) { // we have a valid config
+    if (_configBuffer == NULL) {
+      return -1; // nothing to compare with, keep the stored config
+    }
+    uint32_t len = min(this->getConfigLength(eeprom),
+                       (uint32_t)(MAX_CONFIG_SIZE - CONFIG_OFFSET));
+    // response phase: the boot config is not used anymore, its text and
+    // its place in the arena are reused
+    char *oldConfig = _configBuffer;
     this->getConfigString(eeprom, oldConfig, len);
 #ifdef IODCLIENT_DEBUG_ON
     Serial.println("Loading from EEPROM");
-    Serial.println(String("Length: ") + len);
+    Serial.print("Length: ");
+    Serial.println(len);
     Serial.println(oldConfig);
 #endif
-    DynamicJsonBuffer oldJsonBuffer(1024);
-    JsonObject &oldConfigJson = oldJsonBuffer.parseObject(oldConfig);
-
-    DynamicJsonBuffer newJsonBuffer(1024);
-    JsonObject &newConfigJson = newJsonBuffer.parseObject(newConfig);
-
-    if (hasChanged(oldConfigJson, newConfigJson, "numberOfSamples") ||
-        hasChanged(oldConfigJson, newConfigJson, "sleepTimeMillis") ||
-        hasChanged(oldConfigJson, newConfigJson, "ipv4address") ||
-        hasChanged(oldConfigJson, newConfigJson, "activeSensors") ||
-        hasChanged(oldConfigJson, newConfigJson, "activeFeatures")) {
+    resetJsonArena();
+    // both are parsed in place, the stored text is serialized from the DOM
+    JsonObject &oldConfigJson = _jsonArena.parseObject(oldConfig);
+    JsonObject &newConfigJson = _jsonArena.parseObject(newConfig);
+    logJsonArena("response parse");
 
+    if (!newConfigJson.success()) {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println("Config has changed, writing to EEPROM");
-      Serial.println(String("Length: ") + newConfigString.length());
-      Serial.println(newConfigString);
+      Serial.println("Config does not parse, JSON arena full?");
 #endif
+      return -1; // keep the stored config
+    }
 
-      this->setConfigLength(eeprom, newConfigString.length());
-      this->setConfigString(eeprom, newConfigString.c_str(),
-                            newConfigString.length());
+    if (!hasChanged(oldConfigJson, newConfigJson)) {
+      return 2; // SUCCESS (without saving)
+    }
 
-      if (String(newConfigJson["id"].as<char *>()).equals(uuidString)) {
-        // only commit if config contained our ID
-        if (eeprom.commit()) {
+    const char *id = newConfigJson["id"].as<const char *>();
+    if (id == NULL || strcmp(id, uuidString) != 0) {
+      return -2; // we got a wrong config...
+    }
+
+    if (newConfigJson.measureLength() > MAX_CONFIG_SIZE - CONFIG_OFFSET) {
+      return -1; // would not fit, keep the stored config
+    }
+
+    ConfigWriter writer(eeprom);
+    newConfigJson.printTo(writer);
+    this->setConfigLength(eeprom, writer.length());
 #ifdef IODCLIENT_DEBUG_ON
-          Serial.println("Saved.");
+    Serial.print("Config has changed, writing ");
+    Serial.print(writer.length());
+    Serial.println(" bytes to EEPROM");
 #endif
-          return 1; // SUCCESS (with saving)
-        } else {
+
+    phaseStart(PHASE_CONFIG_STORE);
+    bool saved = eeprom.commit();
+    phaseEnd(PHASE_CONFIG_STORE);
+    if (saved) {
 #ifdef IODCLIENT_DEBUG_ON
-          Serial.println("FAILED.");
+      Serial.println("Saved.");
 #endif
-          return -3; // EEPROM commit failed
-        }
-      } else {
-        return -2; // we got a wrong config...
-      }
+      return 1; // SUCCESS (with saving)
     } else {
-      return 2; // SUCCESS (without saving)
+#ifdef IODCLIENT_DEBUG_ON
+      Serial.println("FAILED.");
+#endif
+      return -3; // EEPROM commit failed
     }
 
   } else {
@@ -204,10 +467,14 @@ uint8_t IoDCoreClient::updateConfig(EEPROMClass &eeprom, char *uuidString) {
   // config not set, get new config
   this->connectToWifi();
 
-  char newConfig[1024];
-  this->fetchConfigString(uuidString, newConfig);
+  // we have no usable config, so make sure to get the full body
+  _rtc.etag[0] = 0;
 
-  return storeConfigIfNewer(eeprom, newConfig, uuidString);
+  this->fetchConfigString(uuidString, _response);
+
+  uint8_t result = storeConfigIfNewer(eeprom, _response, uuidString);
+  acceptETag(result);
+  return result;
 }
 
 void IoDCoreClient::updateUUID(EEPROMClass &eeprom, uint8_t *uuid,
@@ -243,28 +510,39 @@ void IoDCoreClient::updateUUID(EEPROMClass &eeprom, uint8_t *uuid,
 void IoDCoreClient::connectToWifi() {
   // TODO: add possibility to use fixed ip:
   // https://github.com/esp8266/Arduino/issues/1959
+  if (!radioEnabled()) {
+    // booted with WAKE_RF_DISABLED, only a reset brings the radio back. The
+    // next wake measures again and sends regardless of the deadbands.
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.println("Radio is off, rebooting with RF");
+#endif
+    _rtc.flags |= RTC_FLAG_RADIO_WAKE;
+    deepSleep(RF_WAKE_DELAY_MICROS, _planner.radioMode(_rtc));
+  }
+
 #ifdef IODCLIENT_DEBUG_ON
   Serial.println("Enabling WIFI");
 #endif
 
-  uint8_t tries = 0;
+  phaseStart(PHASE_WIFI);
+  uint16_t polls = 0;
   delay(100);
   WiFi.mode(WIFI_STA);
   delay(100);
 
   while (WiFi.status() != WL_CONNECTED) {
-
+    if (polls % WIFI_RETRY_POLLS == 0) {
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Connecting to WIFI");
+      Serial.println("Connecting to WIFI");
 #endif
-
-    if (tries % 10 == 0) {
       WiFi.begin(_wifiSsid, _wifiPass);
     }
 
-    delay(500);
-    tries++;
+    // short polls, the wake goes on as soon as the station is associated
+    waitMillis(WIFI_POLL_MILLIS);
+    polls++;
   }
+  phaseEnd(PHASE_WIFI);
 
 #ifdef IODCLIENT_DEBUG_ON
   Serial.println("Connected to WIFI");
@@ -272,137 +550,699 @@ void IoDCoreClient::connectToWifi() {
 #endif
 }
 
-void IoDCoreClient::fetchConfigString(char *nodeId, char *buf) {
+void IoDCoreClient::preparePaths(const char *nodeId) {
+  if (strcmp(_nodeId, nodeId) == 0) {
+    return; // already done
+  }
 
-  if (WiFi.status() == WL_CONNECTED) {
-    String url = "http://" + String(_iodHost) + ":" + String(_iodPort) +
-                 "/api/node/" + String(nodeId) + "/config";
+  strncpy(_nodeId, nodeId, sizeof(_nodeId) - 1);
+  snprintf(_configPath, MAX_PATH_LENGTH, "/api/node/%s/config", _nodeId);
+  snprintf(_valuesPath, MAX_PATH_LENGTH, "/api/node/%s/values", _nodeId);
+  snprintf(_mqttValuesTopic, MAX_MQTT_TOPIC, "iod/%s/v", _nodeId);
+  snprintf(_mqttConfigTopic, MAX_MQTT_TOPIC, "iod/%s/c", _nodeId);
+  snprintf(_coapValuesPath, MAX_PATH_LENGTH, "n/%s/v", _nodeId);
+  snprintf(_coapQuery, MAX_COAP_QUERY, "auth=%s", _authorization);
+}
 
+void IoDCoreClient::logHeap(const char *where) {
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println(url);
+  Serial.print(where);
+  Serial.print(": free heap ");
+  Serial.print(ESP.getFreeHeap());
+  Serial.print(", fragmentation ");
+  Serial.print(ESP.getHeapFragmentation());
+  Serial.println("%");
 #endif
+}
+
+void IoDCoreClient::useTls(const char *fingerprint) {
+  _tls = true;
+  if (_httpTls == NULL) {
+    // only TLS builds pay for the BearSSL client
+    _httpTls = new BearSSL::WiFiClientSecure();
+  }
+
+  if (fingerprint != NULL) {
+    _httpTls->setFingerprint(fingerprint);
+  } else {
+    _httpTls->setInsecure();
+  }
+  // offering the session id of the last wake lets the server skip the
+  // key exchange, the client updates the session after each handshake
+  _httpTls->setSession(&_tlsSession);
+}
 
-    HTTPClient http;
+Client &IoDCoreClient::httpClient() {
+  if (_tls) {
+    return *_httpTls;
+  }
+  return _httpTcp;
+}
 
+bool IoDCoreClient::resolveHost(IPAddress &address) {
+  if (_rtc.hostAddress != 0 &&
+      clockMillis() - _rtc.hostResolvedAt < DNS_CACHE_TTL) {
+    address = _rtc.hostAddress;
+    return true;
+  }
+
+  phaseStart(PHASE_DNS);
+  bool resolved = WiFi.hostByName(_iodHost, address) == 1 && address.isSet();
+  phaseEnd(PHASE_DNS);
+  if (!resolved) {
+    return false;
+  }
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Beginning");
+  Serial.print("Resolved ");
+  Serial.print(_iodHost);
+  Serial.print(" to ");
+  Serial.println(address);
 #endif
+  _rtc.hostAddress = (uint32_t)address;
+  _rtc.hostResolvedAt = clockMillis();
+  return true;
+}
+
+void IoDCoreClient::forgetHost() { _rtc.hostAddress = 0; }
+
+int IoDCoreClient::sendRequest(HttpRequest &http, const char *method,
+                               const char *path, const char *contentType,
+                               const char *ifNoneMatch, const uint8_t *body,
+                               size_t length) {
+  // TLS needs the host name for SNI, so only plain HTTP skips the lookup
+  IPAddress address;
+  bool known = !_tls && resolveHost(address);
+  if (known) {
+    http.setAddress(address);
+  }
+  if (_tls) {
+    memcpy(_tlsOfferedId, _tlsSession.getSession()->session_id,
+           sizeof(_tlsOfferedId));
+  }
+
+  unsigned long start = millis();
+  int code = http.send(_iodHost, _iodPort, method, path, _authorization,
+                       contentType, ifNoneMatch, body, length);
+
+  if (code == HTTP_ERROR_CONNECTION_FAILED && known) {
+    // the cached address may be stale, resolve once more and retry
+    forgetHost();
+    if (resolveHost(address)) {
+      http.setAddress(address);
+      code = http.send(_iodHost, _iodPort, method, path, _authorization,
+                       contentType, ifNoneMatch, body, length);
+    }
+  }
+
+  logRequestTime(method, start);
+  noteServerHints(http.date(), http.retryAfter());
+  return code;
+}
+
+void IoDCoreClient::noteServerHints(uint32_t date, uint32_t retryAfter) {
+  if (date != 0) {
+    syncClock(date);
+  }
+  if (retryAfter > _retryAfter) {
+    _retryAfter = retryAfter;
+  }
+}
 
-    http.begin(url);
+void IoDCoreClient::valuesRejected(EEPROMClass &eeprom,
+                                   const char *contentType, int code,
+                                   char *uuidString) {
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("error: ");
+  Serial.println(code);
+#endif
+  if (code == HTTP_UNSUPPORTED_MEDIA_TYPE &&
+      strcmp(contentType, CBOR_CONTENT_TYPE) == 0) {
+    // older server, stick to JSON from now on
+    _rtc.flags |= RTC_FLAG_NO_CBOR;
+  }
+  if (code == HTTP_INTERNAL_SERVER_ERROR) {
+    // this can happen if the device has been moved to the wrong server
+    _rtc.etag[0] = 0;
+    fetchConfigString(uuidString, _response); // will register if not registered
+    acceptETag(storeConfigIfNewer(eeprom, _response, uuidString));
+  }
+}
 
+void IoDCoreClient::logRequestTime(const char *what, unsigned long start) {
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Setting auth");
+  Serial.print(what);
+  Serial.print(" took ");
+  Serial.print(millis() - start);
+  Serial.print(" ms");
+  if (_tls) {
+    br_ssl_session_parameters *session = _tlsSession.getSession();
+    bool resumed = session->session_id_len > 0 &&
+                   memcmp(_tlsOfferedId, session->session_id,
+                          sizeof(_tlsOfferedId)) == 0;
+    Serial.print(resumed ? ", TLS resumed" : ", TLS full handshake");
+  }
+  Serial.println();
 #endif
+}
+
+bool IoDCoreClient::isConfigUnchanged(int code, long contentLength) {
+  // 304 for ETag aware servers, an empty body is accepted as well
+  return code == HTTP_NOT_MODIFIED || code == HTTP_NO_CONTENT ||
+         (code == HTTP_OK && contentLength == 0);
+}
+
+void IoDCoreClient::collectETag(const char *etag) {
+  // older servers don't send an ETag, then we never send If-None-Match
+  strncpy(_newETag, etag, RTC_ETAG_LEN - 1);
+  _newETag[RTC_ETAG_LEN - 1] = 0;
+}
+
+void IoDCoreClient::acceptETag(uint8_t storeResult) {
+  // only remember the ETag if its config is the one in EEPROM
+  if (storeResult == 1 || storeResult == 2) {
+    memcpy(_rtc.etag, _newETag, RTC_ETAG_LEN);
+  }
+  _configStored = _configStored || storeResult == 1;
+}
 
-    http.setAuthorization(_iodUser, _iodPass);
+int IoDCoreClient::fetchConfigString(char *nodeId, char *buf) {
+  buf[0] = 0;
+  _newETag[0] = 0;
+
+  if (WiFi.status() == WL_CONNECTED) {
+    preparePaths(nodeId);
 
 #ifdef IODCLIENT_DEBUG_ON
+    Serial.println(_configPath);
     Serial.println("Calling GET");
 #endif
-    int code = http.GET();
+    logHeap("before GET");
+
+    HttpRequest http(httpClient());
+    http.setKeepAlive(true);
+    int code = sendRequest(http, "GET", _configPath, NULL, _rtc.etag, NULL, 0);
 
-    if (code == 200) {
+    if (isConfigUnchanged(code, http.contentLength())) {
+#ifdef IODCLIENT_DEBUG_ON
+      Serial.println("Config not modified");
+#endif
+      http.end();
+      logHeap("after GET");
+      return HTTP_NOT_MODIFIED;
+    } else if (code == HTTP_OK) {
 #ifdef IODCLIENT_DEBUG_ON
       Serial.println("GET successful");
 #endif
-      String payload = http.getString();
+      collectETag(http.etag());
+      http.readBody(buf, MAX_CONFIG_SIZE);
+      http.end();
+      logHeap("after GET");
 
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println(payload);
+      Serial.println(buf);
 #endif
-
-      payload.toCharArray(buf, payload.length() + 1);
-      return;
+      return code;
     } else {
-      if (code == 404) {
-        http.end();
+      http.end();
+      if (code == HTTP_NOT_FOUND) {
 #ifdef IODCLIENT_DEBUG_ON
         Serial.println("Registering");
 #endif
-        http.begin(url);
-        code = http.POST(String(""));
+        code = sendRequest(http, "POST", _configPath, NULL, NULL, NULL, 0);
 
-        if (code == 200) {
-          String regPayload = http.getString();
+        if (code == HTTP_OK) {
+          collectETag(http.etag());
+          http.readBody(buf, MAX_CONFIG_SIZE);
+          http.end();
 #ifdef IODCLIENT_DEBUG_ON
           Serial.println("OK");
-          Serial.println(regPayload);
+          Serial.println(buf);
 #endif
-          regPayload.toCharArray(buf, regPayload.length() + 1);
-          return;
+          return code;
         }
+        http.end();
       }
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println(String("error: ") + code);
+      Serial.print("error: ");
+      Serial.println(code);
 #endif
     }
 
-    http.end(); // Close connection
+    return code;
   }
+
+  return HTTP_ERROR_NOT_CONNECTED;
 }
 
-void IoDCoreClient::postValues(EEPROMClass &eeprom, JsonObject &payload,
-                               char *uuidString) {
+bool IoDCoreClient::acceptsCbor() {
+  return (_rtc.flags & RTC_FLAG_NO_CBOR) == 0;
+}
 
-  if (WiFi.status() == WL_CONNECTED) {
-    String url = "http://" + String(_iodHost) + ":" + String(_iodPort) +
-                 "/api/node/" + String(uuidString) + "/values";
+uint32_t IoDCoreClient::dueSensors(JsonObject &config,
+                                   JsonArray &activeSensors,
+                                   uint32_t sleepTimeMillis, uint8_t stretch) {
+  JsonObject &periods = config["periods"];
+  uint32_t now = clockMillis();
+  uint32_t due = 0;
+
+  _wakePeriod = 0;
+  for (uint8_t i = 0; i < activeSensors.size(); i++) {
+    uint8_t id = sensorId(activeSensors.get<char *>(i));
+    if (id == SENSOR_UNKNOWN) {
+      continue;
+    }
+    _periods[id] = stretch * (periods.containsKey(sensorName(id))
+                                  ? periods[sensorName(id)].as<uint32_t>()
+                                  : sleepTimeMillis);
+    if (_wakePeriod == 0 || _periods[id] < _wakePeriod) {
+      _wakePeriod = _periods[id];
+    }
+  }
+
+  if (_wakePeriod == 0) {
+    _wakePeriod = stretch * sleepTimeMillis; // no sensors, only features
+  }
+
+  for (uint8_t id = 1; id < SENSOR_COUNT; id++) {
+    // wakes are not exact, anything due before the next one is due now
+    if (_periods[id] > 0 &&
+        (_rtc.dueAt[id] == 0 ||
+         (int32_t)(_rtc.dueAt[id] - now) <= (int32_t)(_wakePeriod / 2))) {
+      due |= SENSOR_BIT(id);
+    }
+  }
+
+  return due;
+}
+
+void IoDCoreClient::rememberMeasured(SensorReadings &readings) {
+  uint32_t now = clockMillis();
+  for (uint8_t i = 0; i < readings.count; i++) {
+    uint8_t id = readings.ids[i];
+    _rtc.dueAt[id] = now + _periods[id];
+  }
+}
+
+uint32_t IoDCoreClient::wakePeriod() { return _wakePeriod; }
+
+bool IoDCoreClient::isWorthSending(JsonObject &config,
+                                   SensorReadings &readings) {
+  _deadbands = config.containsKey("deadband");
+  _changed = true;
+  if (_rtc.flags & RTC_FLAG_RADIO_WAKE) {
+    _rtc.flags &= ~RTC_FLAG_RADIO_WAKE;
+    return true;
+  }
+  if (!_deadbands) {
+    return true;
+  }
+
+  // uploads are also what brings config changes, so never skip for long
+  _heartbeat = config.containsKey("heartbeatMillis")
+                   ? config["heartbeatMillis"].as<uint32_t>()
+                   : DEFAULT_HEARTBEAT_MILLIS;
+  if (clockMillis() - _rtc.lastUploadAt >= _heartbeat) {
+    _changed = false;
+    return true;
+  }
+
+  JsonObject &deadband = config["deadband"];
+  for (uint8_t i = 0; i < readings.count; i++) {
+    uint8_t id = readings.ids[i];
+    float band = deadband[sensorName(id)].as<float>(); // 0 if missing
+    // written as !(<=) so that nan (nothing uploaded yet) is a change
+    if (!(fabsf(readings.values[i] - _rtc.lastValues[id]) <= band)) {
+#ifdef IODCLIENT_DEBUG_ON
+      Serial.print(sensorName(id));
+      Serial.println(" left its deadband");
+#endif
+      return true;
+    }
+  }
+
+  _changed = false;
+  return false;
+}
+
+void IoDCoreClient::rememberUpload(SensorReadings &readings) {
+  for (uint8_t i = 0; i < readings.count; i++) {
+    _rtc.lastValues[readings.ids[i]] = readings.values[i];
+  }
+  _rtc.lastUploadAt = clockMillis();
+  memset(_rtc.phaseMillis, 0, sizeof(_rtc.phaseMillis)); // sent along
+}
+
+void IoDCoreClient::rememberVcc(uint16_t millivolts,
+                                uint16_t belowMillivolts) {
+  _rtc.vccMillivolts = millivolts;
+  _rtc.vccBelowMillivolts = belowMillivolts;
+}
+
+const uint16_t *IoDCoreClient::telemetry() {
+  if (!_telemetry) {
+    return NULL;
+  }
+  for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+    if (_rtc.phaseMillis[phase] > 0) {
+      return _rtc.phaseMillis;
+    }
+  }
+  return NULL;
+}
+
+RFMode IoDCoreClient::planNextWake(uint32_t sleepMillis) {
+  uint32_t since = clockMillis() - _rtc.lastUploadAt;
+  uint32_t heartbeatDueIn = since < _heartbeat ? _heartbeat - since : 0;
+  return _planner.plan(_rtc, _deadbands, _changed, heartbeatDueIn, sleepMillis);
+}
+
+static uint32_t wakeJitter(const char *uuidString, uint32_t periodMillis) {
+  // FNV-1a, any stable hash spreads random UUIDs evenly
+  uint32_t hash = 2166136261UL;
+  for (const char *c = uuidString; *c != 0; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619UL;
+  }
+  return hash % periodMillis;
+}
+
+uint64_t IoDCoreClient::nextWakeMicros(uint32_t periodMillis,
+                                       const char *uuidString) {
+  uint64_t backoff = (uint64_t)_retryAfter * 1000;
+  uint64_t now = epochMillis();
+  uint64_t sleepMillis;
+
+  if (now == 0 || periodMillis == 0) {
+    sleepMillis = max((uint64_t)periodMillis, backoff);
+  } else {
+    // the first slot k * period + jitter at least half a period ahead, so
+    // a wake that came a bit early doesn't get a second one right away
+    uint32_t jitter = wakeJitter(uuidString, periodMillis);
+    uint64_t notBefore = now + max((uint64_t)periodMillis / 2, backoff);
+    uint64_t slot =
+        (notBefore - jitter + periodMillis - 1) / periodMillis * periodMillis +
+        jitter;
+    sleepMillis = slot - now;
+    // the sleep timer runs off by driftPpm, ask for the nominal time
+    sleepMillis -= (int64_t)sleepMillis * _rtc.driftPpm / 1000000;
+  }
+
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("Next wake in ");
+  Serial.print((uint32_t)sleepMillis);
+  Serial.println(" ms");
+#endif
+
+  return min(sleepMillis * 1000, ESP.deepSleepMax());
+}
+
+void IoDCoreClient::sleepUntilNextWake(uint32_t periodMillis,
+                                       const char *uuidString) {
+  uint64_t micros = nextWakeMicros(periodMillis, uuidString);
+  deepSleep(micros, planNextWake(micros / 1000));
+}
+
+Transport transportFromString(const char *name) {
+  if (name != NULL && strcmp(name, "mqtt") == 0) {
+    return TRANSPORT_MQTT;
+  }
+  if (name != NULL && strcmp(name, "coap") == 0) {
+    return TRANSPORT_COAP;
+  }
+  return TRANSPORT_HTTP;
+}
+
+void IoDCoreClient::setTransport(Transport transport, bool mqttCleanSession,
+                                 uint8_t coapRetransmits) {
+  _transport = transport;
+  _mqttCleanSession = mqttCleanSession;
+  _coapRetransmits = coapRetransmits;
+}
+
+uint16_t IoDCoreClient::nextMqttPacketId() {
+  // unique within the (persistent) session, 0 is not allowed
+  _rtc.mqttPacketId = _rtc.mqttPacketId % 0xffff + 1;
+  return _rtc.mqttPacketId;
+}
+
+int IoDCoreClient::mqttPostValues(EEPROMClass &eeprom, const uint8_t *body,
+                                  size_t length, char *uuidString) {
+  if (WiFi.status() != WL_CONNECTED) {
+    return HTTP_ERROR_NOT_CONNECTED;
+  }
+
+  preparePaths(uuidString);
 
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println(url);
+  Serial.print("Publishing to ");
+  Serial.println(_mqttValuesTopic);
 #endif
 
-    HTTPClient http;
+  WiFiClient tcp;
+  MqttClient mqtt(tcp);
+  IPAddress address;
+  if (resolveHost(address)) {
+    mqtt.setAddress(address);
+  }
+  mqtt.setMessageBuffer(_response, MAX_CONFIG_SIZE);
+
+  int session = mqtt.connect(_iodHost, _mqttPort, _nodeId, _iodUser,
+                             _iodPass, _mqttCleanSession);
+  if (session < 0) {
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.print("MQTT connect failed: ");
+    Serial.println(session);
+#endif
+    forgetHost(); // resolve again on the next wake
+    return HTTP_ERROR_CONNECTION_FAILED;
+  }
 
+  // A persistent session still holds the config subscription, the broker
+  // then only queues configs that were published while we slept. Otherwise
+  // subscribing gets us the retained config. The values go out even when
+  // it fails, the next wake subscribes again.
+  if (session != 1 || (_rtc.flags & RTC_FLAG_MQTT_UNSUBSCRIBED)) {
+    if (mqtt.subscribe(_mqttConfigTopic, nextMqttPacketId())) {
+      _rtc.flags &= ~RTC_FLAG_MQTT_UNSUBSCRIBED;
+    } else {
+      _rtc.flags |= RTC_FLAG_MQTT_UNSUBSCRIBED;
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Beginning");
+      Serial.println("MQTT subscribe failed");
 #endif
+    }
+  }
 
-    http.begin(url);
-    http.addHeader("Content-Type", "application/json");
+  // values are JSON or CBOR, the server tells them apart by the first byte
+  bool delivered =
+      mqtt.publish(_mqttValuesTopic, body, length, nextMqttPacketId());
+  mqtt.disconnect();
 
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Setting auth");
+  Serial.println(delivered ? "PUBACK received" : "MQTT publish failed");
 #endif
 
-    http.setAuthorization(_iodUser, _iodPass);
+  if (mqtt.messageLength() > 0) {
+    // MQTT configs come without an ETag: an unchanged one keeps ours, a
+    // stored one has none and the next HTTP fetch gets the full body
+    collectETag(_rtc.etag);
+    uint8_t result = storeConfigIfNewer(eeprom, _response, uuidString);
+    if (result == 1) {
+      _newETag[0] = 0;
+    }
+    acceptETag(result);
+  }
+
+  return delivered ? HTTP_OK : HTTP_ERROR_NO_RESPONSE;
+}
 
-    String body;
-    payload.printTo(body);
+int IoDCoreClient::coapPostValues(EEPROMClass &eeprom, const char *contentType,
+                                  const uint8_t *body, size_t length,
+                                  char *uuidString) {
+  if (WiFi.status() != WL_CONNECTED) {
+    return HTTP_ERROR_NOT_CONNECTED;
+  }
+
+  preparePaths(uuidString);
 
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("Caling POST");
-    Serial.println(body);
+  Serial.print("CoAP POST ");
+  Serial.println(_coapValuesPath);
+  unsigned long start = millis();
 #endif
 
-    int code = http.POST(body);
+  WiFiUDP udp;
+  if (!udp.begin(49152 + random(16384))) { // any dynamic port will do
+    return HTTP_ERROR_CONNECTION_FAILED;
+  }
+
+  CoapClient coap(udp, _rtc.coapMessageId);
+  coap.setRetransmits(_coapRetransmits);
+  IPAddress address;
+  if (resolveHost(address)) {
+    coap.setAddress(address);
+  }
+
+  uint16_t format = strcmp(contentType, CBOR_CONTENT_TYPE) == 0
+                        ? COAP_CONTENT_CBOR
+                        : COAP_CONTENT_JSON;
+  // CoAP ETags are at most 8 bytes, longer ones are simply not sent
+  int code = coap.post(_iodHost, _coapPort, _coapValuesPath, _coapQuery,
+                       format, _rtc.etag, body, length, _response,
+                       MAX_CONFIG_SIZE);
+  _rtc.coapMessageId = coap.messageId();
+  udp.stop();
 
-    if (code == 200) {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println("POST successful");
+  Serial.print("CoAP result ");
+  Serial.print(code);
+  Serial.print(" after ");
+  Serial.print(millis() - start);
+  Serial.println(" ms");
+#endif
+
+  if (code < 0) {
+    forgetHost(); // resolve again on the next wake
+    return code == COAP_ERROR_SEND_FAILED ? HTTP_ERROR_CONNECTION_FAILED
+                                          : HTTP_ERROR_NO_RESPONSE;
+  }
+  if (code >= 200 && code < 300) {
+    // 2.03 Valid or no payload: the config we have is still current
+    if (code != 203 && coap.payloadLength() > 0) {
+      strncpy(_newETag, coap.etag(), RTC_ETAG_LEN - 1);
+      _newETag[RTC_ETAG_LEN - 1] = 0;
+      acceptETag(storeConfigIfNewer(eeprom, _response, uuidString));
+    }
+    return HTTP_OK;
+  }
+
+  // 4.15 and 5.00 map onto the HTTP codes of the same number
+  if (code == HTTP_UNSUPPORTED_MEDIA_TYPE && format == COAP_CONTENT_CBOR) {
+    _rtc.flags |= RTC_FLAG_NO_CBOR;
+  }
+  if (code == HTTP_INTERNAL_SERVER_ERROR) {
+    _rtc.etag[0] = 0;
+    fetchConfigString(uuidString, _response); // will register if not registered
+    acceptETag(storeConfigIfNewer(eeprom, _response, uuidString));
+  }
+  return code;
+}
+
+int IoDCoreClient::postValues(EEPROMClass &eeprom, const char *contentType,
+                              const uint8_t *body, size_t length,
+                              char *uuidString) {
+  int code = HTTP_ERROR_NOT_CONNECTED;
+
+  if (_transport == TRANSPORT_MQTT) {
+    return mqttPostValues(eeprom, body, length, uuidString);
+  }
+  if (_transport == TRANSPORT_COAP) {
+    return coapPostValues(eeprom, contentType, body, length, uuidString);
+  }
+
+  if (WiFi.status() == WL_CONNECTED) {
+    preparePaths(uuidString);
+
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.println(_valuesPath);
+    Serial.print("Caling POST, ");
+    Serial.print(contentType);
+    Serial.print(", ");
+    Serial.print(length);
+    Serial.println(" bytes");
 #endif
-      String payload = http.getString();
+    logHeap("before POST");
+
+    HttpRequest http(httpClient());
+    http.setKeepAlive(true);
+    // no If-None-Match: on a POST a failed condition is a 412, not a 304,
+    // and the values would be rejected. An unchanged config is not stored.
+    code = sendRequest(http, "POST", _valuesPath, contentType, NULL, body,
+                       length);
 
+    if (isConfigUnchanged(code, http.contentLength())) {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println(payload);
+      Serial.println("POST successful, config not modified");
 #endif
-      char newConfig[1024];
-      payload.toCharArray(newConfig, payload.length() + 1);
-      storeConfigIfNewer(eeprom, newConfig, uuidString);
+      http.end();
+    } else if (code == HTTP_OK) {
+#ifdef IODCLIENT_DEBUG_ON
+      Serial.println("POST successful");
+#endif
+      collectETag(http.etag());
+      http.readBody(_response, MAX_CONFIG_SIZE);
+      http.end();
 
-      return;
-    } else {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println(String("error: ") + code);
+      Serial.println(_response);
 #endif
-      if (code == 500) {
-        // this can happen if the device has been moved to the wrong server
-        char newConfig[1024];
-        fetchConfigString(uuidString, newConfig); // will register if not registered
-        storeConfigIfNewer(eeprom, newConfig, uuidString);
-      }
+      acceptETag(storeConfigIfNewer(eeprom, _response, uuidString));
+    } else {
+      http.end();
+      valuesRejected(eeprom, contentType, code, uuidString);
     }
 
-    http.end(); // Close connection
+    logHeap("after POST");
+  }
+
+  return code;
+}
+
+bool IoDCoreClient::postValuesAsync(EEPROMClass &eeprom,
+                                    const char *contentType,
+                                    const uint8_t *body, size_t length,
+                                    char *uuidString) {
+  if (_transport != TRANSPORT_HTTP) {
+    // one datagram or packet, nothing worth overlapping
+    _uploadCode = postValues(eeprom, contentType, body, length, uuidString);
+    return true;
+  }
+  if (_upload.busy() || WiFi.status() != WL_CONNECTED) {
+    return false;
+  }
+  preparePaths(uuidString);
+
+  IPAddress address;
+  if (!_tls && resolveHost(address)) {
+    _upload.setAddress(address);
+  }
+  if (_tls) {
+    memcpy(_tlsOfferedId, _tlsSession.getSession()->session_id,
+           sizeof(_tlsOfferedId));
+  }
+
+  _uploadEeprom = &eeprom;
+  _uploadContentType = contentType;
+  _uploadStart = millis();
+  _upload.onResponse(onUploadResponse, this);
+  if (!_upload.start(httpClient(), _iodHost, _iodPort, "POST", _valuesPath,
+                     _authorization, contentType, NULL, body, length)) {
+    forgetHost(); // maybe a stale address, resolve again next time
+    _uploadCode = HTTP_ERROR_CONNECTION_FAILED;
+    return false;
+  }
+  return true;
+}
+
+bool IoDCoreClient::pollUpload() { return _upload.poll(); }
+
+void IoDCoreClient::onUploadResponse(HttpResponse &response, void *context) {
+  ((IoDCoreClient *)context)->uploadDone(response);
+}
+
+void IoDCoreClient::uploadDone(HttpResponse &response) {
+  int code = response.code;
+  _uploadCode = code;
+  logRequestTime("async POST", _uploadStart);
+  noteServerHints(response.headers.date, response.headers.retryAfter);
+
+  // the same config update path as postValues()
+  if (isConfigUnchanged(code, response.headers.contentLength)) {
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.println("POST successful, config not modified");
+#endif
+  } else if (code == HTTP_OK) {
+    collectETag(response.headers.etag);
+    acceptETag(storeConfigIfNewer(*_uploadEeprom, response.body, _nodeId));
+  } else {
+    valuesRejected(*_uploadEeprom, _uploadContentType, code, _nodeId);
   }
 }
@@ -4,22 +4,157 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
+#include "AsyncHttpRequest.hpp"
+#include "CoapClient.hpp"
+#include "HttpRequest.hpp"
+#include "MqttClient.hpp"
+#include "PowerDomains.hpp"
+#include "RtcState.hpp"
+#include "SensorReadings.hpp"
+#include "VccPolicy.hpp"
+#include "WakePlanner.hpp"
 
 #define MAX_CONFIG_SIZE                                                        \
   1024 // estimation via https://arduinojson.org/v5/assistant/
 
+// MEMORY MAP
+// 4 bytes magic number [8,1,19,21] to know if we  "have a UUID"
+#define UUID_OFFSET 4
+#define UUID_LEN 16
+// 16 bytes UUID
+#define CONFIG_LEN_OFFSET (UUID_OFFSET + 16)
+// 4 bytes config length
+#define CONFIG_OFFSET (CONFIG_LEN_OFFSET + 4)
+// [...] config, up to MAX_CONFIG_SIZE - CONFIG_OFFSET bytes
+
+// Worst case DOM of one config as sent by the server (scalars plus the
+// arrays of active sensors/features, the precision, deadband and periods
+// objects, the BME280 list, the power domains and the VCC levels). The
+// arena has to hold two of them while the stored and the received config
+// are compared.
+#define MAX_CONFIG_KEYS 40
+#define MAX_FEATURES 8
+#define CONFIG_JSON_SIZE                                                       \
+  (JSON_OBJECT_SIZE(MAX_CONFIG_KEYS) + JSON_ARRAY_SIZE(SENSOR_COUNT) +        \
+   JSON_ARRAY_SIZE(MAX_FEATURES) + 3 * JSON_OBJECT_SIZE(SENSOR_COUNT) +       \
+   JSON_ARRAY_SIZE(MAX_BME280) + MAX_BME280 * JSON_OBJECT_SIZE(2) +           \
+   JSON_ARRAY_SIZE(MAX_POWER_DOMAINS) +                                       \
+   MAX_POWER_DOMAINS * JSON_OBJECT_SIZE(5) +                                  \
+   JSON_ARRAY_SIZE(MAX_VCC_LEVELS) +                                          \
+   MAX_VCC_LEVELS * (JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(SENSOR_COUNT)))
+#define JSON_ARENA_SIZE (2 * CONFIG_JSON_SIZE)
+
+// The one JSON pool of a wake. Its phases (boot config parse, response
+// parse) don't overlap, resetJsonArena() starts the next one.
+typedef StaticJsonBuffer<JSON_ARENA_SIZE> JsonArena;
+
+// how values get to the server, "transport" in the node config
+enum Transport { TRANSPORT_HTTP, TRANSPORT_MQTT, TRANSPORT_COAP };
+
+Transport transportFromString(const char *name);
+
+#define UUID_STRING_LENGTH 36 // 16 * 2 hex digits + 4 dashes
+#define MAX_PATH_LENGTH 64    // "/api/node/<uuid>/config"
+#define MAX_COAP_QUERY (5 + MAX_AUTHORIZATION_LENGTH) // "auth=<base64>"
+#define MAX_CREDENTIALS_LENGTH 64
+#define DNS_CACHE_TTL (60UL * 60 * 1000) // lwIP doesn't expose the real TTL
+#define DEFAULT_HEARTBEAT_MILLIS (60UL * 60 * 1000)
+#define RF_WAKE_DELAY_MICROS 10000 // reboot to get the radio back
+#define WIFI_POLL_MILLIS 20
+#define WIFI_RETRY_POLLS 250 // WiFi.begin() again every 5 s
+#define DRIFT_MIN_SPAN (30UL * 60 * 1000) // Date only has 1 s resolution
+#define MAX_DRIFT_PPM 100000
+#define MAX_AUTHORIZATION_LENGTH ((MAX_CREDENTIALS_LENGTH + 2) / 3 * 4 + 1)
+
 class IoDCoreClient {
 private:
   char *_wifiSsid;
   char *_wifiPass;
   char *_iodHost;
   uint16_t _iodPort;
+  uint16_t _mqttPort;
+  uint16_t _coapPort;
   char *_iodUser;
   char *_iodPass;
 
+  RtcState _rtc;
+  char _newETag[RTC_ETAG_LEN]; // ETag of the last received config
+
+  // prepared once, so requests don't need to build any Strings
+  char _authorization[MAX_AUTHORIZATION_LENGTH]; // base64("user:pass")
+  char _nodeId[UUID_STRING_LENGTH + 1];
+  char _configPath[MAX_PATH_LENGTH];
+  char _valuesPath[MAX_PATH_LENGTH];
+  char _mqttValuesTopic[MAX_MQTT_TOPIC]; // iod/<uuid>/v
+  char _mqttConfigTopic[MAX_MQTT_TOPIC]; // iod/<uuid>/c
+  char _coapValuesPath[MAX_PATH_LENGTH];  // n/<uuid>/v
+  char _coapQuery[MAX_COAP_QUERY];
+
+  Transport _transport;
+  bool _mqttCleanSession;
+  uint8_t _coapRetransmits;
+
+  bool _tls;
+  BearSSL::Session _tlsSession; // lives in _rtc.tlsSession while sleeping
+  uint8_t _tlsOfferedId[32];    // session id sent in the last ClientHello
+
+  // kept open between the requests of a wake
+  WiFiClient _httpTcp;
+  BearSSL::WiFiClientSecure *_httpTls; // created by useTls()
+
+  WakePlanner _planner;
+  bool _deadbands; // what isWorthSending() found out, for planNextWake()
+  bool _changed;
+  uint32_t _heartbeat;
+  uint32_t _retryAfter; // seconds the server asked us to back off
+  uint32_t _periods[SENSOR_COUNT]; // measurement period of each sensor
+  uint32_t _wakePeriod;            // the shortest of the active ones
+  bool _configStored;
+  bool _telemetry;
+
+  AsyncHttpRequest _upload;
+  EEPROMClass *_uploadEeprom;
+  const char *_uploadContentType;
+  unsigned long _uploadStart;
+  int _uploadCode;
+
+  JsonArena _jsonArena;
+  size_t _jsonArenaPeak;
+
+  // config responses of all transports, one at a time; static like the
+  // client itself, the cont stack only has 4 KB
+  char _response[MAX_CONFIG_SIZE];
+  char *_configBuffer; // see setConfigBuffer()
+
+  void preparePaths(const char *nodeId);
+  void logHeap(const char *where);
+  Client &httpClient();
+  void syncClock(uint32_t epoch);
+  uint64_t epochMillis();
+  bool resolveHost(IPAddress &address);
+  void forgetHost();
+  int sendRequest(HttpRequest &http, const char *method, const char *path,
+                  const char *contentType, const char *ifNoneMatch,
+                  const uint8_t *body, size_t length);
+  void logRequestTime(const char *what, unsigned long start);
+  void valuesRejected(EEPROMClass &eeprom, const char *contentType, int code,
+                      char *uuidString);
+  static void onUploadResponse(HttpResponse &response, void *context);
+  void uploadDone(HttpResponse &response);
+  void noteServerHints(uint32_t date, uint32_t retryAfter);
+  bool isConfigUnchanged(int code, long contentLength);
+  void collectETag(const char *etag);
+  void acceptETag(uint8_t storeResult);
+  uint16_t nextMqttPacketId();
+  int mqttPostValues(EEPROMClass &eeprom, const uint8_t *body, size_t length,
+                     char *uuidString);
+  int coapPostValues(EEPROMClass &eeprom, const char *contentType,
+                     const uint8_t *body, size_t length, char *uuidString);
+
 public:
   IoDCoreClient(char *wifiSsid, char *wifiPass, char *iodHost, uint16_t iodPort,
-                char *iodUser, char *iodPass);
+                char *iodUser, char *iodPass, uint16_t mqttPort = 1883,
+                uint16_t coapPort = 5683);
 
   bool hasUUID(EEPROMClass &eeprom);
   void createUUID(uint8_t *uuid);
@@ -33,17 +168,89 @@ public:
   void getConfigString(EEPROMClass &eeprom, char *json, uint32_t length);
   void setConfigString(EEPROMClass &eeprom, const char *json, uint32_t length);
 
+  // Where the caller keeps the text of its parsed stored config (at least
+  // MAX_CONFIG_SIZE bytes). storeConfigIfNewer() reads the stored config
+  // there again to compare it with a received one, so that DOM is gone
+  // afterwards, as with every reset of the arena.
+  void setConfigBuffer(char *json) { _configBuffer = json; }
+
+  JsonArena &jsonArena();
+  void resetJsonArena();
+  size_t jsonArenaPeak();
+  void logJsonArena(const char *phase);
+
   bool hasKey(JsonArray *jsonArray, const char *key);
-  bool hasChanged(JsonObject &oldObject, JsonObject &newObject,
-                  const char *entry);
+  bool hasChanged(JsonObject &oldObject, JsonObject &newObject);
   void updateUUID(EEPROMClass &eeprom, uint8_t *uuid, char *uuidString);
   uint8_t storeConfigIfNewer(EEPROMClass &eeprom, char *newConfig,
                              char *uuidString);
   uint8_t updateConfig(EEPROMClass &eeprom, char *uuidString);
+  // a changed config from the server went to EEPROM since boot
+  bool configStored() { return _configStored; }
+
+  void loadState();
+  uint32_t clockMillis();
+  // seconds since 1970 as learned from the server, 0 while unknown
+  uint32_t epochNow();
+  bool radioEnabled();
+  void deepSleep(uint64_t micros, RFMode mode);
+
+  // HTTPS for config and values, fingerprint is the SHA-1 of the server
+  // certificate ("AB:CD:..."), or NULL to encrypt without authentication.
+  void useTls(const char *fingerprint);
+  void setTransport(Transport transport, bool mqttCleanSession,
+                    uint8_t coapRetransmits = COAP_MAX_RETRANSMIT);
 
   void connectToWifi();
-  void fetchConfigString(char *nodeId, char *buf);
-  void postValues(EEPROMClass &eeprom, JsonObject &values, char *uuidString);
+  int fetchConfigString(char *nodeId, char *buf);
+  bool acceptsCbor();
+
+  // Sensors can have their own period in the optional "periods" object,
+  // e.g. {"BME280_BARO": 900000}, the others use sleepTimeMillis. Wakes
+  // follow the shortest period and return the active sensors that are due
+  // as a set of SENSOR_BIT()s. All periods are multiplied by stretch.
+  uint32_t dueSensors(JsonObject &config, JsonArray &activeSensors,
+                      uint32_t sleepTimeMillis, uint8_t stretch = 1);
+  // moves the measured sensors to their next slot, only once the wake is
+  // past the send decision (a radio wake has to measure them again)
+  void rememberMeasured(SensorReadings &readings);
+  uint32_t wakePeriod();
+
+  // send-on-delta: false while all readings stay within the "deadband" of
+  // their last upload and the "heartbeatMillis" have not passed yet
+  bool isWorthSending(JsonObject &config, SensorReadings &readings);
+  void rememberUpload(SensorReadings &readings);
+  // last valid VCC reading and the threshold of the VCC level in effect
+  uint16_t lastVccMillivolts() { return _rtc.vccMillivolts; }
+  uint16_t lastVccBelowMillivolts() { return _rtc.vccBelowMillivolts; }
+  void rememberVcc(uint16_t millivolts, uint16_t belowMillivolts);
+  // With "telemetry": true in the config, the phase times of the wakes
+  // since the last upload go along with the next one (latest per phase).
+  void setTelemetry(bool enabled) { _telemetry = enabled; }
+  // ms by WakePhase, 0 for phases without a time; NULL if there is nothing
+  // to send
+  const uint16_t *telemetry();
+  // RF mode for the next wake, after isWorthSending() and the upload
+  RFMode planNextWake(uint32_t sleepMillis);
+
+  // Sleep until the next slot of periodMillis on the wall clock, offset by
+  // a jitter derived from the UUID so that the fleet spreads over the
+  // period. Relative to now while the time is unknown. Honors Retry-After.
+  uint64_t nextWakeMicros(uint32_t periodMillis, const char *uuidString);
+  void sleepUntilNextWake(uint32_t periodMillis, const char *uuidString);
+  int postValues(EEPROMClass &eeprom, const char *contentType,
+                 const uint8_t *body, size_t length, char *uuidString);
+
+  // Like postValues(), but over HTTP it returns as soon as the request is
+  // queued. pollUpload() moves it along, the response then goes through
+  // the same config update. false if the previous upload is still running
+  // or there is no connection. Other transports block as before.
+  bool postValuesAsync(EEPROMClass &eeprom, const char *contentType,
+                       const uint8_t *body, size_t length, char *uuidString);
+  // returns true while an upload is in flight
+  bool pollUpload();
+  // status of the last upload, HTTP_ERROR_* on failures
+  int uploadCode() { return _uploadCode; }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "LightSleep.hpp"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+extern "C" {
+#include <gpio.h>
+#include <user_interface.h>
+}
+
+extern os_timer_t *timer_list;
+
+static bool allowed = false;
+static uint32_t slept = 0;
+static uint32_t sleeps = 0;
+
+static uint32_t rtcMillisSince(uint32_t rtcStart) {
+  uint64_t ticks = system_get_rtc_time() - rtcStart;
+  return ((ticks * system_rtc_clock_cali_proc()) >> 12) / 1000;
+}
+
+// puts the timers set aside back in front of those armed meanwhile, they
+// are overdue and fire right away (late, but none is lost)
+static void restoreTimers(os_timer_t *pending) {
+  if (pending == NULL) {
+    return;
+  }
+  os_timer_t *last = pending;
+  while (last->timer_next != NULL) {
+    last = last->timer_next;
+  }
+  last->timer_next = timer_list;
+  timer_list = pending;
+}
+
+void allowLightSleep(bool lightSleepAllowed) { allowed = lightSleepAllowed; }
+
+uint32_t lightSleptMillis() { return slept; }
+
+uint32_t uptimeMillis() { return millis() + slept; }
+
+uint32_t lightSleepSavedMicroampSeconds() {
+  // each sleep keeps us awake 1 ms longer than the busy wait would have
+  uint64_t saved = (uint64_t)slept * (ACTIVE_MICROAMPS - LIGHT_SLEEP_MICROAMPS);
+  uint64_t extra = (uint64_t)sleeps * ACTIVE_MICROAMPS;
+  return saved > extra ? (saved - extra) / 1000 : 0;
+}
+
+void waitMillis(uint32_t ms, uint8_t wakePin, bool wakeHigh) {
+  if (!allowed || ms < LIGHT_SLEEP_MIN_MILLIS) {
+    delay(ms);
+    return;
+  }
+
+  wifi_set_opmode_current(NULL_MODE);
+  wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+  wifi_fpm_open();
+  if (wakePin != NO_WAKE_PIN) {
+    gpio_pin_wakeup_enable(GPIO_ID_PIN(wakePin), wakeHigh
+                                                     ? GPIO_PIN_INTR_HILEVEL
+                                                     : GPIO_PIN_INTR_LOLEVEL);
+  }
+
+  // the RTC timer keeps running, it tells how long we really slept when a
+  // pin ended the sleep early
+  uint32_t rtcStart = system_get_rtc_time();
+  unsigned long start = millis();
+  // pending OS timers keep the SDK from entering forced light sleep, they
+  // are set aside until the wake
+  os_timer_t *pending = timer_list;
+  timer_list = NULL;
+  wifi_fpm_do_sleep(ms * 1000);
+  // the sleep starts once the CPU idles in this one delay(), which has to
+  // outlast the sleep timer or the SDK stays in modem sleep
+  delay(ms + 1);
+  restoreTimers(pending);
+  uint32_t sleptMillis = rtcMillisSince(rtcStart);
+  unsigned long counted = millis() - start;
+  if (sleptMillis > counted) {
+    slept += sleptMillis - counted;
+  }
+  sleeps++;
+
+  if (wakePin != NO_WAKE_PIN) {
+    gpio_pin_wakeup_disable();
+  }
+  wifi_fpm_close();
+}
@@ -0,0 +1,31 @@
+#ifndef LIGHT_SLEEP
+#define LIGHT_SLEEP
+
+#include <Arduino.h>
+
+#define LIGHT_SLEEP_MIN_MILLIS 10 // shorter waits cost more to enter and leave
+#define NO_WAKE_PIN 0xff
+
+// rough supply currents for the debug estimate, radio off at 80 MHz
+#define ACTIVE_MICROAMPS 15000
+#define LIGHT_SLEEP_MICROAMPS 400
+
+// Forced light sleep needs the radio off, the caller tells whether it is
+// (a wake booted with WAKE_RF_DISABLED). Otherwise waits stay plain delay()s
+// and the SDK modem-sleeps on its own while the station is associated.
+void allowLightSleep(bool allowed);
+
+// waits ms, in forced light sleep if allowed and ms >= LIGHT_SLEEP_MIN_MILLIS;
+// a level on wakePin ends the sleep early, the rest of the wait is awake.
+// Pending OS timers (Ticker) are held back while it sleeps and fire late.
+void waitMillis(uint32_t ms, uint8_t wakePin = NO_WAKE_PIN,
+                bool wakeHigh = false);
+
+// the timer behind millis() stops in light sleep, uptimeMillis() adds it back
+uint32_t lightSleptMillis();
+uint32_t uptimeMillis();
+
+// rough charge the light sleep saved this wake over busy waits, in uAs
+uint32_t lightSleepSavedMicroampSeconds();
+
+#endif
@@ -0,0 +1,256 @@
+#include "MqttClient.hpp"
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_SUBSCRIBE 0x82 // with the mandatory reserved flags
+#define MQTT_SUBACK 0x90
+#define MQTT_DISCONNECT 0xe0
+
+#define MQTT_FLAG_CLEAN_SESSION 0x02
+#define MQTT_FLAG_PASSWORD 0x40
+#define MQTT_FLAG_USER 0x80
+#define MQTT_QOS1 0x02
+#define MQTT_SUBACK_FAILURE 0x80
+
+static size_t putString(uint8_t *buf, const char *s) {
+  size_t len = strlen(s);
+  buf[0] = len >> 8;
+  buf[1] = len;
+  memcpy(buf + 2, s, len);
+  return len + 2;
+}
+
+MqttClient::MqttClient(Client &client) : _client(client) {
+  _message = NULL;
+  _messageSize = 0;
+  _messageLength = 0;
+}
+
+void MqttClient::setMessageBuffer(char *buf, size_t size) {
+  _message = buf;
+  _messageSize = size;
+  _messageLength = 0;
+}
+
+int MqttClient::readByte() {
+  unsigned long start = millis();
+  while (!_client.available()) {
+    if (!_client.connected() || millis() - start > MQTT_TIMEOUT) {
+      return -1;
+    }
+    delay(1);
+  }
+  return _client.read();
+}
+
+bool MqttClient::writePacket(uint8_t type, const uint8_t *header,
+                             size_t headerLength, const uint8_t *payload,
+                             size_t length) {
+  // fixed header, then the variable header, so both go out in one write
+  uint8_t packet[5 + MAX_MQTT_HEADER];
+  size_t remaining = headerLength + length;
+  size_t n = 0;
+
+  packet[n++] = type;
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    packet[n++] = remaining > 0 ? digit | 0x80 : digit;
+  } while (remaining > 0);
+
+  if (headerLength > 0) {
+    memcpy(packet + n, header, headerLength);
+    n += headerLength;
+  }
+
+  bool ok = _client.write(packet, n) == n;
+  if (ok && length > 0) {
+    ok = _client.write(payload, length) == length;
+  }
+  return ok;
+}
+
+bool MqttClient::sendAck(uint8_t type, uint16_t packetId) {
+  uint8_t header[2] = {(uint8_t)(packetId >> 8), (uint8_t)packetId};
+  return writePacket(type, header, sizeof(header), NULL, 0);
+}
+
+bool MqttClient::readPublish(uint8_t flags, size_t remaining) {
+  uint8_t qos = (flags >> 1) & 0x03;
+  uint16_t packetId = 0;
+  int hi, lo, c;
+
+  // we don't care about the topic, there is only one subscription
+  if ((hi = readByte()) < 0 || (lo = readByte()) < 0) {
+    return false;
+  }
+  size_t topicLength = (hi << 8) | lo;
+  size_t header = 2 + topicLength + (qos > 0 ? 2 : 0);
+  if (header > remaining) {
+    return false;
+  }
+  for (size_t i = 0; i < topicLength; i++) {
+    if (readByte() < 0) {
+      return false;
+    }
+  }
+  if (qos > 0) {
+    if ((hi = readByte()) < 0 || (lo = readByte()) < 0) {
+      return false;
+    }
+    packetId = (hi << 8) | lo;
+  }
+
+  size_t length = remaining - header;
+  size_t stored = 0;
+  for (size_t i = 0; i < length; i++) {
+    if ((c = readByte()) < 0) {
+      return false;
+    }
+    if (_message != NULL && stored < _messageSize - 1) {
+      _message[stored++] = c;
+    }
+  }
+
+  // an empty message only clears a retained one, nothing to hand over
+  if (_message != NULL && length > 0) {
+    _message[stored] = 0;
+    _messageLength = stored;
+  }
+
+  return qos == 0 || sendAck(MQTT_PUBACK, packetId);
+}
+
+int MqttClient::waitFor(uint8_t type, uint16_t packetId) {
+  // reads packets until the expected one arrives, messages that come in on
+  // the way are stored. Returns the first byte of a CONNACK, 0 for acks.
+  while (true) {
+    int header = readByte();
+    if (header < 0) {
+      return MQTT_ERROR_TIMEOUT;
+    }
+
+    size_t remaining = 0;
+    uint8_t shift = 0;
+    int c;
+    do {
+      if ((c = readByte()) < 0) {
+        return MQTT_ERROR_TIMEOUT;
+      }
+      remaining |= (size_t)(c & 0x7f) << shift;
+      shift += 7;
+    } while ((c & 0x80) && shift < 28);
+
+    if ((header & 0xf0) == MQTT_PUBLISH) {
+      if (!readPublish(header & 0x0f, remaining)) {
+        return MQTT_ERROR_TIMEOUT;
+      }
+      continue;
+    }
+
+    uint8_t body[4] = {0, 0, 0, 0};
+    for (size_t i = 0; i < remaining; i++) {
+      if ((c = readByte()) < 0) {
+        return MQTT_ERROR_TIMEOUT;
+      }
+      if (i < sizeof(body)) {
+        body[i] = c;
+      }
+    }
+
+    if ((header & 0xf0) != (type & 0xf0)) {
+      continue; // not for us
+    }
+
+    if (type == MQTT_CONNACK) {
+      // [session present, return code]
+      return body[1] == 0 ? body[0] & 0x01 : MQTT_ERROR_REFUSED;
+    }
+    if (((body[0] << 8) | body[1]) == packetId) {
+      return type == MQTT_SUBACK && body[2] == MQTT_SUBACK_FAILURE
+                 ? MQTT_ERROR_REFUSED
+                 : 0;
+    }
+  }
+}
+
+int MqttClient::connect(const char *host, uint16_t port, const char *clientId,
+                        const char *user, const char *pass,
+                        bool cleanSession) {
+  static const uint8_t protocol[] = {0, 4, 'M', 'Q', 'T', 'T', 4};
+
+  if (strlen(clientId) + strlen(user) + strlen(pass) + sizeof(protocol) + 9 >
+      MAX_MQTT_HEADER) {
+    return MQTT_ERROR_CONNECTION_FAILED;
+  }
+  bool connected = _address.isSet() ? _client.connect(_address, port)
+                                     : _client.connect(host, port);
+  if (!connected) {
+    return MQTT_ERROR_CONNECTION_FAILED;
+  }
+
+  uint8_t header[MAX_MQTT_HEADER];
+  size_t n = sizeof(protocol);
+  memcpy(header, protocol, n);
+  header[n++] = MQTT_FLAG_USER | MQTT_FLAG_PASSWORD |
+                (cleanSession ? MQTT_FLAG_CLEAN_SESSION : 0);
+  header[n++] = MQTT_KEEP_ALIVE >> 8;
+  header[n++] = MQTT_KEEP_ALIVE & 0xff;
+  n += putString(header + n, clientId);
+  n += putString(header + n, user);
+  n += putString(header + n, pass);
+
+  if (!writePacket(MQTT_CONNECT, header, n, NULL, 0)) {
+    _client.stop();
+    return MQTT_ERROR_CONNECTION_FAILED;
+  }
+
+  int session = waitFor(MQTT_CONNACK, 0);
+  if (session < 0) {
+    _client.stop();
+  }
+  return session;
+}
+
+bool MqttClient::subscribe(const char *topic, uint16_t packetId) {
+  uint8_t header[2 + 2 + MAX_MQTT_TOPIC + 1];
+  size_t n = 0;
+
+  if (strlen(topic) > MAX_MQTT_TOPIC) {
+    return false;
+  }
+
+  header[n++] = packetId >> 8;
+  header[n++] = packetId;
+  n += putString(header + n, topic);
+  header[n++] = 1; // QoS1
+
+  return writePacket(MQTT_SUBSCRIBE, header, n, NULL, 0) &&
+         waitFor(MQTT_SUBACK, packetId) == 0;
+}
+
+bool MqttClient::publish(const char *topic, const uint8_t *payload,
+                         size_t length, uint16_t packetId) {
+  uint8_t header[2 + MAX_MQTT_TOPIC + 2];
+  size_t n = 0;
+
+  if (strlen(topic) > MAX_MQTT_TOPIC) {
+    return false;
+  }
+
+  n += putString(header, topic);
+  header[n++] = packetId >> 8;
+  header[n++] = packetId;
+
+  return writePacket(MQTT_PUBLISH | MQTT_QOS1, header, n, payload, length) &&
+         waitFor(MQTT_PUBACK, packetId) == 0;
+}
+
+void MqttClient::disconnect() {
+  writePacket(MQTT_DISCONNECT, NULL, 0, NULL, 0);
+  _client.stop();
+}
@@ -0,0 +1,54 @@
+#ifndef MQTT_CLIENT
+#define MQTT_CLIENT
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define MQTT_TIMEOUT 5000
+#define MQTT_KEEP_ALIVE 60
+#define MAX_MQTT_TOPIC 64
+#define MAX_MQTT_HEADER 192 // CONNECT with client id, user and password
+
+#define MQTT_ERROR_CONNECTION_FAILED -1
+#define MQTT_ERROR_REFUSED -2
+#define MQTT_ERROR_TIMEOUT -3
+
+// Minimal MQTT 3.1.1 client: CONNECT, QoS1 PUBLISH/SUBSCRIBE and receiving
+// QoS0/1 messages into one fixed buffer. Just enough for one short session
+// per wake, no heap and no background processing.
+class MqttClient {
+private:
+  Client &_client;
+  IPAddress _address;
+  char *_message;
+  size_t _messageSize;
+  size_t _messageLength;
+
+  int readByte();
+  bool writePacket(uint8_t type, const uint8_t *header, size_t headerLength,
+                   const uint8_t *payload, size_t length);
+  bool sendAck(uint8_t type, uint16_t packetId);
+  bool readPublish(uint8_t flags, size_t remaining);
+  int waitFor(uint8_t type, uint16_t packetId);
+
+public:
+  MqttClient(Client &client);
+
+  // skips the DNS lookup of host in connect()
+  void setAddress(IPAddress address) { _address = address; }
+
+  // incoming messages are copied into buf, the latest one wins
+  void setMessageBuffer(char *buf, size_t size);
+  size_t messageLength() { return _messageLength; }
+
+  // Returns 1 if the broker still had our session (subscriptions and queued
+  // messages), 0 for a new session, < 0 on errors.
+  int connect(const char *host, uint16_t port, const char *clientId,
+              const char *user, const char *pass, bool cleanSession);
+  bool subscribe(const char *topic, uint16_t packetId);
+  bool publish(const char *topic, const uint8_t *payload, size_t length,
+               uint16_t packetId);
+  void disconnect();
+};
+
+#endif
@@ -0,0 +1,259 @@
+#include "PayloadEncoder.hpp"
+#include "CborWriter.hpp"
+#include "FixedPoint.hpp"
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define CBOR_KEY_DATA_ID 0
+#define CBOR_KEY_VALUES 1
+#define CBOR_KEY_TIME 2
+#define CBOR_KEY_TELEMETRY 3
+
+void loadPrecision(JsonObject &config, uint8_t decimals[SENSOR_COUNT]) {
+  JsonObject &precision = config["precision"];
+
+  for (uint8_t id = 0; id < SENSOR_COUNT; id++) {
+    decimals[id] = VALUES_DECIMALS;
+    if (id != SENSOR_UNKNOWN && precision.containsKey(sensorName(id))) {
+      decimals[id] = min(precision[sensorName(id)].as<uint8_t>(),
+                         (uint8_t)MAX_DECIMALS);
+    }
+  }
+}
+
+PayloadTemplate::PayloadTemplate() {
+  _prefixLength = 0;
+  for (uint8_t id = 0; id < SENSOR_COUNT; id++) {
+    _keyOffset[id] = 0;
+    _keyLength[id] = 0;
+    _decimals[id] = VALUES_DECIMALS;
+  }
+}
+
+bool PayloadTemplate::build(JsonVariant dataId, JsonArray &activeSensors,
+                            uint8_t decimals[SENSOR_COUNT]) {
+  static const char head[] = "{\"dataId\":";
+  static const char tail[] = ",\"values\":{";
+
+  size_t length = sizeof(head) - 1 + dataId.measureLength() + sizeof(tail) - 1;
+  if (length >= MAX_PAYLOAD_PREFIX) {
+    return false;
+  }
+
+  _prefixLength = sizeof(head) - 1;
+  memcpy(_prefix, head, _prefixLength);
+  _prefixLength += dataId.printTo(_prefix + _prefixLength,
+                                  MAX_PAYLOAD_PREFIX - _prefixLength);
+  memcpy(_prefix + _prefixLength, tail, sizeof(tail)); // incl. terminator
+  _prefixLength += sizeof(tail) - 1;
+
+  size_t keysLength = 0;
+  for (uint8_t i = 0; i < activeSensors.size(); i++) {
+    uint8_t id = sensorId(activeSensors.get<char *>(i));
+    if (id == SENSOR_UNKNOWN || _keyLength[id] > 0) {
+      continue; // not a sensor we produce values for
+    }
+
+    // "<name>":"
+    const char *name = sensorName(id);
+    size_t length = strlen(name) + 4;
+    if (keysLength + length > MAX_PAYLOAD_KEYS) {
+      return false;
+    }
+
+    char *key = _keys + keysLength;
+    key[0] = '"';
+    memcpy(key + 1, name, length - 4);
+    memcpy(key + length - 3, "\":\"", 3);
+
+    _keyOffset[id] = keysLength;
+    _keyLength[id] = length;
+    keysLength += length;
+  }
+
+  memcpy(_decimals, decimals, SENSOR_COUNT);
+  return true;
+}
+
+static bool append(char *buf, size_t capacity, size_t &length, const char *src,
+                   size_t n) {
+  if (length + n >= capacity) {
+    return false;
+  }
+  memcpy(buf + length, src, n);
+  length += n;
+  return true;
+}
+
+bool PayloadTemplate::appendValues(char *buf, size_t capacity, size_t &length,
+                                   const uint8_t *ids, const float *values,
+                                   uint8_t count, bool squared) {
+  bool first = true;
+  char value[MAX_FIXED_LENGTH + 1];
+
+  for (uint8_t i = 0; i < count; i++) {
+    uint8_t id = ids[i];
+    if (id >= SENSOR_COUNT || _keyLength[id] == 0) {
+      continue;
+    }
+
+    uint8_t decimals =
+        squared ? min(2 * _decimals[id], MAX_DECIMALS) : _decimals[id];
+    size_t valueLength = formatFixed(value, values[i], decimals);
+    value[valueLength++] = '"';
+
+    if ((!first && !append(buf, capacity, length, ",", 1)) ||
+        !append(buf, capacity, length, _keys + _keyOffset[id],
+                _keyLength[id]) ||
+        !append(buf, capacity, length, value, valueLength)) {
+      return false;
+    }
+    first = false;
+  }
+
+  return append(buf, capacity, length, "}", 1);
+}
+
+static bool appendTime(char *buf, size_t capacity, size_t &length,
+                       uint32_t time) {
+  if (time == 0) {
+    return true;
+  }
+  char field[20];
+  size_t fieldLength =
+      snprintf(field, sizeof(field), ",\"time\":%lu", (unsigned long)time);
+  return append(buf, capacity, length, field, fieldLength);
+}
+
+static bool appendTelemetry(char *buf, size_t capacity, size_t &length,
+                            const uint16_t *telemetry) {
+  if (telemetry == NULL) {
+    return true;
+  }
+
+  const char *separator = ",\"telemetry\":{";
+  for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+    if (telemetry[phase] == 0) {
+      continue;
+    }
+    char field[40];
+    size_t fieldLength =
+        snprintf(field, sizeof(field), "%s\"%s\":%u", separator,
+                 phaseName(phase), (unsigned)telemetry[phase]);
+    if (!append(buf, capacity, length, field, fieldLength)) {
+      return false;
+    }
+    separator = ",";
+  }
+  return append(buf, capacity, length, "}", 1);
+}
+
+size_t PayloadTemplate::render(SensorReadings &readings, char *buf,
+                               size_t capacity, const uint16_t *telemetry) {
+  size_t length = 0;
+
+  if (!append(buf, capacity, length, _prefix, _prefixLength) ||
+      !appendValues(buf, capacity, length, readings.ids, readings.values,
+                    readings.count, false) ||
+      !appendTime(buf, capacity, length, readings.time) ||
+      !appendTelemetry(buf, capacity, length, telemetry) ||
+      !append(buf, capacity, length, "}", 1)) {
+    return 0;
+  }
+  buf[length] = 0;
+
+  return length;
+}
+
+size_t PayloadTemplate::renderWindow(SensorWindow &window, char *buf,
+                                     size_t capacity) {
+  uint8_t ids[SENSOR_COUNT];
+  float means[SENSOR_COUNT], mins[SENSOR_COUNT], maxs[SENSOR_COUNT],
+      variances[SENSOR_COUNT];
+  uint8_t count = 0;
+
+  for (uint8_t id = 0; id < SENSOR_COUNT; id++) {
+    RunningStats &stats = window.stats[id];
+    if (stats.count == 0) {
+      continue;
+    }
+    ids[count] = id;
+    means[count] = stats.mean;
+    mins[count] = stats.minimum;
+    maxs[count] = stats.maximum;
+    variances[count] = stats.variance();
+    count++;
+  }
+
+  size_t length = 0;
+  char counters[48];
+  size_t countersLength =
+      snprintf(counters, sizeof(counters),
+               ",\"window\":{\"samples\":%lu,\"dropped\":%lu",
+               (unsigned long)window.samples, (unsigned long)window.dropped);
+
+  if (!append(buf, capacity, length, _prefix, _prefixLength) ||
+      !appendValues(buf, capacity, length, ids, means, count, false) ||
+      !appendTime(buf, capacity, length, window.time) ||
+      !append(buf, capacity, length, counters, countersLength) ||
+      !append(buf, capacity, length, ",\"min\":{", 8) ||
+      !appendValues(buf, capacity, length, ids, mins, count, false) ||
+      !append(buf, capacity, length, ",\"max\":{", 8) ||
+      !appendValues(buf, capacity, length, ids, maxs, count, false) ||
+      !append(buf, capacity, length, ",\"variance\":{", 13) ||
+      !appendValues(buf, capacity, length, ids, variances, count, true) ||
+      !append(buf, capacity, length, "}}", 2)) {
+    return 0;
+  }
+  buf[length] = 0;
+
+  return length;
+}
+
+size_t encodeCborPayload(uint8_t *buf, size_t capacity, JsonVariant dataId,
+                         SensorReadings &readings,
+                         uint8_t decimals[SENSOR_COUNT],
+                         const uint16_t *telemetry) {
+  CborWriter cbor(buf, capacity);
+
+  uint8_t phases = 0;
+  for (uint8_t phase = 0; telemetry != NULL && phase < PHASE_COUNT; phase++) {
+    phases += telemetry[phase] > 0;
+  }
+  cbor.writeMap(2 + (readings.time != 0) + (phases > 0));
+
+  cbor.writeUInt(CBOR_KEY_DATA_ID);
+  if (dataId.is<const char *>()) {
+    cbor.writeText(dataId.as<const char *>());
+  } else {
+    cbor.writeInt(dataId.as<long>());
+  }
+
+  cbor.writeUInt(CBOR_KEY_VALUES);
+  cbor.writeMap(readings.count);
+  for (uint8_t i = 0; i < readings.count; i++) {
+    uint8_t id = readings.ids[i];
+    cbor.writeUInt(id);
+    cbor.writeDecimal(readings.values[i],
+                      id < SENSOR_COUNT ? decimals[id] : VALUES_DECIMALS);
+  }
+
+  if (readings.time != 0) {
+    cbor.writeUInt(CBOR_KEY_TIME);
+    cbor.writeUInt(readings.time);
+  }
+
+  if (phases > 0) {
+    cbor.writeUInt(CBOR_KEY_TELEMETRY);
+    cbor.writeMap(phases);
+    for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+      if (telemetry[phase] > 0) {
+        cbor.writeUInt(phase);
+        cbor.writeUInt(telemetry[phase]);
+      }
+    }
+  }
+
+  return cbor.overflowed() ? 0 : cbor.size();
+}
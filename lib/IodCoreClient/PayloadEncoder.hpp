@@ -0,0 +1,71 @@
+#ifndef PAYLOAD_ENCODER
+#define PAYLOAD_ENCODER
+
+#include "SensorReadings.hpp"
+#include "WakeTelemetry.hpp"
+#include "WindowStats.hpp"
+#include <ArduinoJson.h>
+
+#define JSON_CONTENT_TYPE "application/json"
+#define CBOR_CONTENT_TYPE "application/cbor"
+
+#define MAX_JSON_PAYLOAD_SIZE 640
+#define MAX_WINDOW_PAYLOAD_SIZE 768
+#define MAX_CBOR_PAYLOAD_SIZE 256
+#define MAX_PAYLOAD_PREFIX 80
+#define MAX_PAYLOAD_KEYS 255 // offsets are uint8_t
+#define VALUES_DECIMALS 2 // same precision as String(float)
+
+// Decimals for every SensorId, VALUES_DECIMALS unless the config has an
+// entry in its optional "precision" object, e.g. {"BME280_TEMP": 1}.
+void loadPrecision(JsonObject &config, uint8_t decimals[SENSOR_COUNT]);
+
+// {"dataId": <dataId>, "values": {"BME280_TEMP": "23.45", ...}, "time": <s>,
+//  "telemetry": {"boot": <ms>, "wifi": <ms>, ...}}
+// "time" is left out while the node doesn't know the time yet, "telemetry"
+// without phase times (only the phases with a time are listed).
+//
+// The payload shape only depends on the config, so the skeleton (dataId and
+// the keys of the active sensors) is prepared once, rendering then only
+// copies it and formats the values in fixed-point, without heap or DOM.
+class PayloadTemplate {
+private:
+  char _prefix[MAX_PAYLOAD_PREFIX]; // {"dataId":<dataId>,"values":{
+  size_t _prefixLength;
+  char _keys[MAX_PAYLOAD_KEYS]; // "BME280_TEMP":""BME280_HYGRO":"...
+  uint8_t _keyOffset[SENSOR_COUNT];
+  uint8_t _keyLength[SENSOR_COUNT]; // 0 if the sensor is not active
+  uint8_t _decimals[SENSOR_COUNT];
+
+  // "<key>":"<value>",... of the active sensors and the closing brace,
+  // squared values (variances) get twice the decimals
+  bool appendValues(char *buf, size_t capacity, size_t &length,
+                    const uint8_t *ids, const float *values, uint8_t count,
+                    bool squared);
+
+public:
+  PayloadTemplate();
+
+  bool build(JsonVariant dataId, JsonArray &activeSensors,
+             uint8_t decimals[SENSOR_COUNT]);
+
+  // returns the length written to buf, 0 if it did not fit
+  size_t render(SensorReadings &readings, char *buf, size_t capacity,
+                const uint16_t *telemetry = NULL);
+
+  // continuous mode: the means as "values", plus
+  // "window": {"samples": n, "dropped": n, "min": {...}, "max": {...},
+  //            "variance": {...}}
+  size_t renderWindow(SensorWindow &window, char *buf, size_t capacity);
+};
+
+// {0: <dataId>, 1: {1: 4([-2, 2345]), ...}, 2: <time>, 3: {0: <ms>, ...}},
+// the sensors are keyed by their SensorId and the values are decimal
+// fractions, the telemetry by WakePhase. Returns the encoded length, 0 if
+// buf was too small.
+size_t encodeCborPayload(uint8_t *buf, size_t capacity, JsonVariant dataId,
+                         SensorReadings &readings,
+                         uint8_t decimals[SENSOR_COUNT],
+                         const uint16_t *telemetry = NULL);
+
+#endif
@@ -0,0 +1,188 @@
+//#define IODCLIENT_DEBUG_ON 1
+
+#include "BME280Handler.hpp"
+#include "LightSleep.hpp"
+#include "PowerDomains.hpp"
+#include <Arduino.h>
+#include <Wire.h>
+#include <limits.h>
+
+#define BME280_CHIP_ID_ADDR 0xD0
+#define BME280_STATUS_ADDR 0xF3
+#define BME280_IM_UPDATE 0x01
+#define BME280_CHIP_ID 0x60
+#define BMP280_CHIP_ID 0x58
+
+static bool readRegister(uint8_t address, uint8_t reg, uint8_t &value) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  if (Wire.endTransmission() != 0 ||
+      Wire.requestFrom(address, (uint8_t)1) != 1) {
+    return false;
+  }
+  value = Wire.read();
+  return true;
+}
+
+static PowerProbe probeFromString(const char *name, PowerProbe fallback) {
+  if (name == NULL) {
+    return fallback;
+  }
+  if (strcmp(name, "bme280") == 0) {
+    return PROBE_BME280;
+  }
+  if (strcmp(name, "ack") == 0) {
+    return PROBE_ACK;
+  }
+  return PROBE_NONE;
+}
+
+PowerDomains::PowerDomains() {
+  _count = 0;
+  _busPins = 0;
+}
+
+bool PowerDomains::add(uint8_t pin, bool activeHigh, uint16_t maxSettleMillis,
+                       uint8_t i2cAddress, PowerProbe probe) {
+  if (pin < 32 && (_busPins & bit(pin))) {
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.print("Power domain IO");
+    Serial.print(pin);
+    Serial.println(" is an SPI bus pin, ignored");
+#endif
+    return false;
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    if (_domains[i].pin == pin) {
+      return true; // configured explicitly and as a feature
+    }
+  }
+  if (_count >= MAX_POWER_DOMAINS) {
+    return false;
+  }
+
+  PowerDomain &domain = _domains[_count++];
+  domain.pin = pin;
+  domain.activeHigh = activeHigh;
+  domain.maxSettleMillis = maxSettleMillis;
+  domain.i2cAddress = i2cAddress;
+  domain.probe = probe;
+  domain.settledMillis = 0;
+  domain.ready = false;
+  return true;
+}
+
+void PowerDomains::load(JsonObject &config, JsonArray &activeFeatures) {
+  _count = 0;
+  // an SPI BME280 can't answer the I2C probes, its domains only wait
+  _busPins = bme280SpiPins(config);
+  PowerProbe probe = _busPins != 0 ? PROBE_NONE : PROBE_BME280;
+
+  JsonArray &domains = config["powerDomains"];
+  for (uint8_t i = 0; i < domains.size(); i++) {
+    JsonObject &domain = domains[i];
+    if (!domain.containsKey("pin")) {
+      continue;
+    }
+    add(domain["pin"].as<uint8_t>(),
+        domain.containsKey("activeHigh") ? domain["activeHigh"].as<bool>()
+                                         : true,
+        domain.containsKey("maxSettleMillis")
+            ? domain["maxSettleMillis"].as<uint16_t>()
+            : DEFAULT_SETTLE_MILLIS,
+        domain.containsKey("i2cAddress") ? domain["i2cAddress"].as<uint8_t>()
+                                         : DEFAULT_PROBE_ADDRESS,
+        probeFromString(domain["probe"].as<const char *>(), probe));
+  }
+
+  for (uint8_t i = 0; i < activeFeatures.size(); i++) {
+    const char *feature = activeFeatures.get<const char *>(i);
+    if (feature != NULL && strcmp(feature, "I2C_DEVICE_ON_IO13") == 0) {
+      add(13, true, DEFAULT_SETTLE_MILLIS, DEFAULT_PROBE_ADDRESS, probe);
+    } else if (feature != NULL && strcmp(feature, "I2C_DEVICE_ON_IO0") == 0) {
+      add(0, true, DEFAULT_SETTLE_MILLIS, DEFAULT_PROBE_ADDRESS, probe);
+    }
+  }
+}
+
+bool PowerDomains::isReady(PowerDomain &domain) {
+  uint8_t value;
+
+  switch (domain.probe) {
+  case PROBE_ACK:
+    Wire.beginTransmission(domain.i2cAddress);
+    return Wire.endTransmission() == 0;
+  case PROBE_BME280:
+    // the calibration data must be in place before BME280::begin() reads it
+    return readRegister(domain.i2cAddress, BME280_CHIP_ID_ADDR, value) &&
+           (value == BME280_CHIP_ID || value == BMP280_CHIP_ID) &&
+           readRegister(domain.i2cAddress, BME280_STATUS_ADDR, value) &&
+           (value & BME280_IM_UPDATE) == 0;
+  default:
+    return false;
+  }
+}
+
+unsigned long PowerDomains::nextPoll(unsigned long elapsed) {
+  // domains without a probe only time out, nothing to poll until then
+  unsigned long wait = ULONG_MAX;
+  for (uint8_t i = 0; i < _count; i++) {
+    PowerDomain &domain = _domains[i];
+    if (domain.ready) {
+      continue;
+    }
+    if (domain.probe != PROBE_NONE) {
+      return 1;
+    }
+    wait = min(wait, (unsigned long)domain.maxSettleMillis - elapsed);
+  }
+  return wait;
+}
+
+void PowerDomains::powerUp() {
+  for (uint8_t i = 0; i < _count; i++) {
+    pinMode(_domains[i].pin, OUTPUT);
+    digitalWrite(_domains[i].pin, _domains[i].activeHigh ? HIGH : LOW);
+    _domains[i].ready = false;
+  }
+
+  unsigned long start = uptimeMillis();
+  uint8_t pending = _count;
+  while (pending > 0) {
+    unsigned long elapsed = uptimeMillis() - start;
+
+    for (uint8_t i = 0; i < _count; i++) {
+      PowerDomain &domain = _domains[i];
+      if (domain.ready) {
+        continue;
+      }
+
+      bool timedOut = elapsed >= domain.maxSettleMillis;
+      if (timedOut || isReady(domain)) {
+        domain.ready = true;
+        domain.settledMillis = elapsed;
+        pending--;
+
+#ifdef IODCLIENT_DEBUG_ON
+        Serial.print("Power domain IO");
+        Serial.print(domain.pin);
+        Serial.print(timedOut && domain.probe != PROBE_NONE
+                         ? " did not answer within "
+                         : " settled after ");
+        Serial.print(elapsed);
+        Serial.println(" ms");
+#endif
+      }
+    }
+
+    if (pending > 0) {
+      waitMillis(nextPoll(elapsed));
+    }
+  }
+}
+
+void PowerDomains::powerDown() {
+  for (uint8_t i = 0; i < _count; i++) {
+    digitalWrite(_domains[i].pin, _domains[i].activeHigh ? LOW : HIGH);
+  }
+}
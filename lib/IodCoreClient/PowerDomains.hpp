@@ -0,0 +1,61 @@
+#ifndef POWER_DOMAINS
+#define POWER_DOMAINS
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define MAX_POWER_DOMAINS 4
+#define DEFAULT_SETTLE_MILLIS 200
+#define DEFAULT_PROBE_ADDRESS 0x76 // BME280 with SDO to GND
+
+// how to tell that the device behind a power pin is up
+enum PowerProbe {
+  PROBE_NONE,  // no way to ask, always wait maxSettleMillis
+  PROBE_ACK,   // the device ACKs its I2C address
+  PROBE_BME280 // chip id readable and the NVM copy (im_update) finished
+};
+
+struct PowerDomain {
+  uint8_t pin;
+  bool activeHigh;
+  uint16_t maxSettleMillis;
+  uint8_t i2cAddress;
+  PowerProbe probe;
+  uint16_t settledMillis; // measured on power up, for tuning maxSettleMillis
+  bool ready;
+};
+
+// Sensors powered from GPIOs. All domains are switched on together and
+// probed until they answer, so a wake only waits as long as the slowest
+// device actually needs instead of a fixed delay per pin.
+class PowerDomains {
+private:
+  PowerDomain _domains[MAX_POWER_DOMAINS];
+  uint8_t _count;
+  uint32_t _busPins; // GPIOs of the SPI bus, never used as power pins
+
+  bool add(uint8_t pin, bool activeHigh, uint16_t maxSettleMillis,
+           uint8_t i2cAddress, PowerProbe probe);
+  bool isReady(PowerDomain &domain);
+  unsigned long nextPoll(unsigned long elapsed);
+
+public:
+  PowerDomains();
+
+  // From the optional "powerDomains" array of the config, e.g.
+  // [{"pin": 13, "activeHigh": true, "maxSettleMillis": 200,
+  //   "i2cAddress": 118, "probe": "bme280"}],
+  // plus the I2C_DEVICE_ON_IO13/IO0 features as BME280 domains. With the
+  // BME280 on SPI ("bme280Bus") the default probe is "none", and a domain
+  // on one of the bus pins (IO13 is MOSI) is rejected.
+  void load(JsonObject &config, JsonArray &activeFeatures);
+
+  // returns once every domain answered or ran into its maxSettleMillis
+  void powerUp();
+  void powerDown();
+
+  uint8_t count() { return _count; }
+  const PowerDomain &get(uint8_t i) { return _domains[i]; }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef RING_BUFFER
+#define RING_BUFFER
+
+#include <Arduino.h>
+
+// Bounded single-producer single-consumer queue. The producer only writes
+// _head and the consumer only _tail, so one side may run from a timer
+// callback without locking. Holds N - 1 items, N must be a power of two.
+template <typename T, size_t N> class RingBuffer {
+private:
+  T _items[N];
+  volatile size_t _head;
+  volatile size_t _tail;
+
+  static_assert((N & (N - 1)) == 0, "RingBuffer size must be a power of two");
+
+public:
+  RingBuffer() : _head(0), _tail(0) {}
+
+  // producer side, false if the consumer fell behind
+  bool push(const T &item) {
+    size_t next = (_head + 1) & (N - 1);
+    if (next == _tail) {
+      return false;
+    }
+    _items[_head] = item;
+    _head = next;
+    return true;
+  }
+
+  // consumer side, the oldest item stays queued until pop(), NULL if empty
+  T *front() { return _tail == _head ? NULL : &_items[_tail]; }
+  void pop() {
+    if (_tail != _head) {
+      _tail = (_tail + 1) & (N - 1);
+    }
+  }
+};
+
+#endif
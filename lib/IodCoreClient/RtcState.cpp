@@ -0,0 +1,37 @@
+#include "RtcState.hpp"
+#include <Arduino.h>
+
+static uint32_t rtcCrc32(const uint8_t *data, size_t length) {
+  uint32_t crc = 0xffffffff;
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t rtcStateCrc(RtcState &state) {
+  // everything behind the crc field
+  return rtcCrc32((uint8_t *)&state + sizeof(state.crc),
+                  sizeof(RtcState) - sizeof(state.crc));
+}
+
+bool loadRtcState(RtcState &state) {
+  if (ESP.rtcUserMemoryRead(0, (uint32_t *)&state, sizeof(RtcState)) &&
+      state.magic == RTC_STATE_MAGIC && state.crc == rtcStateCrc(state)) {
+    return true;
+  }
+
+  // cold boot (or new layout): start from scratch
+  memset(&state, 0, sizeof(RtcState));
+  state.magic = RTC_STATE_MAGIC;
+  return false;
+}
+
+void saveRtcState(RtcState &state) {
+  state.magic = RTC_STATE_MAGIC;
+  state.crc = rtcStateCrc(state);
+  ESP.rtcUserMemoryWrite(0, (uint32_t *)&state, sizeof(RtcState));
+}
@@ -0,0 +1,50 @@
+#ifndef RTC_STATE
+#define RTC_STATE
+
+#include "SensorReadings.hpp"
+#include "WakeTelemetry.hpp"
+#include <Arduino.h>
+
+// bump the version byte whenever the layout of RtcState changes, a stale
+// layout from an older firmware is then simply discarded.
+#define RTC_STATE_MAGIC 0x494f440e // 'I' 'O' 'D' + version
+#define RTC_ETAG_LEN 40
+#define RTC_TLS_SESSION_LEN 88 // >= sizeof(br_ssl_session_parameters)
+
+#define RTC_FLAG_NO_CBOR 0x01 // server answered 415 to a CBOR upload
+#define RTC_FLAG_RF_OFF 0x02  // this wake was booted with WAKE_RF_DISABLED
+#define RTC_FLAG_RADIO_WAKE 0x04 // woken up just to send, skip deadbands
+#define RTC_FLAG_DRIFT_KNOWN 0x08 // driftPpm has been measured at least once
+#define RTC_FLAG_MQTT_UNSUBSCRIBED 0x10 // the config SUBSCRIBE failed
+
+// State that survives deep sleep (but not a power cycle). It is kept in the
+// 512 bytes of RTC user memory, so keep it small and 4-byte aligned.
+struct RtcState {
+  uint32_t crc;
+  uint32_t magic;
+  char etag[RTC_ETAG_LEN]; // ETag of the config we have stored in EEPROM
+  uint32_t flags;
+  uint32_t mqttPacketId; // last packet id used in our MQTT session
+  uint32_t coapMessageId; // next CoAP message id, must not repeat too soon
+  uint8_t tlsSession[RTC_TLS_SESSION_LEN]; // for abbreviated handshakes
+  uint32_t clockMillis;    // awake plus slept time since the cold boot
+  uint32_t hostAddress;    // cached IPv4 of the server, 0 if unknown
+  uint32_t hostResolvedAt; // clockMillis when hostAddress was resolved
+  uint32_t lastUploadAt;   // clockMillis of the last successful upload
+  float lastValues[SENSOR_COUNT]; // as uploaded by SensorId, nan if never
+  uint32_t rfCalCountdown; // radio wakes until the next RF calibration
+  uint32_t syncEpoch;  // server time of the last Date header, 0 if none
+  uint32_t syncClock;  // clockMillis at syncEpoch
+  uint32_t driftEpoch; // start of the current drift measurement
+  uint32_t driftClock;
+  int32_t driftPpm; // how much faster real time runs than clockMillis
+  uint32_t dueAt[SENSOR_COUNT]; // clockMillis of the next measurement
+  uint16_t phaseMillis[PHASE_COUNT]; // wake telemetry not uploaded yet
+  uint16_t vccMillivolts;      // last valid VCC reading, 0 if none yet
+  uint16_t vccBelowMillivolts; // threshold of the VCC level in effect
+};
+
+bool loadRtcState(RtcState &state);
+void saveRtcState(RtcState &state);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef SENSOR_DRIVER
+#define SENSOR_DRIVER
+
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// One kind of sensor in the wake pipeline. The SensorRegistry triggers every
+// driver with due sensors first, sleeps until the latest readyAt() and only
+// then reads them all, so their conversions overlap.
+class SensorDriver {
+public:
+  virtual ~SensorDriver() {}
+
+  // the SensorIds this driver measures (SENSOR_BIT()s), valid after begin()
+  virtual uint32_t sensors() = 0;
+  // Takes the driver's part of the config. Runs before the active sensors
+  // are resolved by name (a driver may rename its sensors) and before the
+  // power domains are up, so no bus traffic here.
+  virtual void begin(JsonObject &config) = 0;
+  // starts measuring the due sensors, false if nothing was started
+  virtual bool trigger(uint32_t due) = 0;
+  // uptimeMillis() from which on the results can be read
+  virtual uint32_t readyAt() = 0;
+  // fetches the results from the device
+  virtual void read() = 0;
+  // adds the values of the due sensors to the readings
+  virtual void encode(SensorReadings &readings) = 0;
+};
+
+#endif
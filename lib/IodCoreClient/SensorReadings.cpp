@@ -0,0 +1,72 @@
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+
+static_assert(SENSOR_BME280_2_DEW == MAX_BME280 * BME280_CHANNELS,
+              "one block of SensorIds per BME280");
+
+static const char *channelNames[BME280_CHANNELS] = {
+    "_TEMP", "_HYGRO", "_BARO", "_ALTI", "_DEW",
+};
+
+// built on first use, the BME280 prefixes come from the config
+static char sensorNames[SENSOR_COUNT][MAX_SENSOR_NAME];
+
+static void nameBME280(uint8_t n, const char *prefix) {
+  for (uint8_t channel = 0; channel < BME280_CHANNELS; channel++) {
+    char *name = sensorNames[BME280_SENSOR(n, SENSOR_BME280_TEMP) + channel];
+    strcpy(name, prefix);
+    strcat(name, channelNames[channel]);
+  }
+}
+
+static void nameSensors() {
+  if (sensorNames[SENSOR_BME280_TEMP][0] != 0) {
+    return;
+  }
+
+  nameBME280(0, "BME280");
+  nameBME280(1, "BME280_2");
+  strcpy(sensorNames[SENSOR_VCC], "VCC");
+}
+
+bool setBME280Prefix(uint8_t n, const char *prefix) {
+  if (n >= MAX_BME280 || prefix == NULL ||
+      strlen(prefix) >= MAX_SENSOR_PREFIX) {
+    return false;
+  }
+
+  nameSensors();
+  nameBME280(n, prefix);
+  return true;
+}
+
+const char *sensorName(uint8_t id) {
+  nameSensors();
+  return id < SENSOR_COUNT ? sensorNames[id] : sensorNames[SENSOR_UNKNOWN];
+}
+
+uint8_t sensorId(const char *name) {
+  if (name == NULL) {
+    return SENSOR_UNKNOWN;
+  }
+
+  nameSensors();
+  for (uint8_t id = 1; id < SENSOR_COUNT; id++) {
+    if (strcmp(name, sensorNames[id]) == 0) {
+      return id;
+    }
+  }
+
+  return SENSOR_UNKNOWN;
+}
+
+bool SensorReadings::add(uint8_t id, float value) {
+  if (count >= MAX_READINGS) {
+    return false;
+  }
+
+  ids[count] = id;
+  values[count] = value;
+  count++;
+  return true;
+}
@@ -0,0 +1,52 @@
+#ifndef SENSOR_READINGS
+#define SENSOR_READINGS
+
+#include <Arduino.h>
+
+#define MAX_BME280 2
+#define BME280_CHANNELS 5
+#define MAX_READINGS (MAX_BME280 * BME280_CHANNELS + 1) // plus VCC
+#define MAX_SENSOR_PREFIX 16
+#define MAX_SENSOR_NAME (MAX_SENSOR_PREFIX + 6) // prefix + "_HYGRO"
+
+// Integer IDs of the sensors, used by the compact upload formats. Never
+// renumber these, the server maps them back to the names below.
+enum SensorId {
+  SENSOR_UNKNOWN = 0,
+  SENSOR_BME280_TEMP = 1,
+  SENSOR_BME280_HYGRO = 2,
+  SENSOR_BME280_BARO = 3,
+  SENSOR_BME280_ALTI = 4,
+  SENSOR_BME280_DEW = 5,
+  SENSOR_BME280_2_TEMP = 6, // the second BME280, named "BME280_2_*"
+  SENSOR_BME280_2_HYGRO = 7,
+  SENSOR_BME280_2_BARO = 8,
+  SENSOR_BME280_2_ALTI = 9,
+  SENSOR_BME280_2_DEW = 10,
+  SENSOR_VCC = 11, // supply voltage in V
+  SENSOR_COUNT
+};
+
+#define SENSOR_BIT(id) (1UL << (id)) // sets of SensorIds
+// a channel (SENSOR_BME280_TEMP..DEW) of the n-th BME280
+#define BME280_SENSOR(n, channel) ((channel) + (n) * BME280_CHANNELS)
+
+const char *sensorName(uint8_t id);
+uint8_t sensorId(const char *name);
+// Renames the channels of the n-th BME280 to "<prefix>_TEMP" and so on,
+// false if the prefix is too long or n out of range.
+bool setBME280Prefix(uint8_t n, const char *prefix);
+
+// The values measured during one wake, filled in by the sensor handlers.
+struct SensorReadings {
+  uint8_t count;
+  uint8_t ids[MAX_READINGS];
+  float values[MAX_READINGS];
+  uint32_t time; // seconds since 1970 when measured, 0 if unknown
+
+  SensorReadings() : count(0), time(0) {}
+
+  bool add(uint8_t id, float value);
+};
+
+#endif
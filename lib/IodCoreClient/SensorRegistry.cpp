@@ -0,0 +1,96 @@
+//#define IODCLIENT_DEBUG_ON 1
+
+#include "SensorRegistry.hpp"
+#include "BME280Handler.hpp"
+#include "LightSleep.hpp"
+#include "SensorDriver.hpp"
+#include "VccPolicy.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// every sensor driver the firmware has
+static SensorDriver *const sensorDrivers[] = {
+    &bme280Driver,
+    &vccDriver,
+};
+#define SENSOR_DRIVER_COUNT (sizeof(sensorDrivers) / sizeof(sensorDrivers[0]))
+
+static_assert(SENSOR_DRIVER_COUNT <= MAX_SENSOR_DRIVERS,
+              "too many sensor drivers");
+
+SensorRegistry::SensorRegistry() {
+  _count = SENSOR_DRIVER_COUNT;
+  for (uint8_t i = 0; i < _count; i++) {
+    _drivers[i] = sensorDrivers[i];
+    _active[i] = 0;
+  }
+  memset(_driverOf, NO_DRIVER, sizeof(_driverOf));
+}
+
+void SensorRegistry::load(JsonObject &config, JsonArray &activeSensors) {
+  memset(_driverOf, NO_DRIVER, sizeof(_driverOf));
+  for (uint8_t i = 0; i < _count; i++) {
+    _drivers[i]->begin(config);
+    _active[i] = 0;
+
+    uint32_t sensors = _drivers[i]->sensors();
+    for (uint8_t id = 1; id < SENSOR_COUNT; id++) {
+      if ((sensors & SENSOR_BIT(id)) && _driverOf[id] == NO_DRIVER) {
+        _driverOf[id] = i;
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < activeSensors.size(); i++) {
+    uint8_t id = sensorId(activeSensors.get<char *>(i));
+    if (id != SENSOR_UNKNOWN && _driverOf[id] != NO_DRIVER) {
+      _active[_driverOf[id]] |= SENSOR_BIT(id);
+    }
+  }
+}
+
+SensorDriver *SensorRegistry::driverOf(uint8_t id) {
+  if (id >= SENSOR_COUNT || _driverOf[id] == NO_DRIVER) {
+    return NULL;
+  }
+  return _drivers[_driverOf[id]];
+}
+
+void SensorRegistry::measure(uint32_t due, SensorReadings &readings) {
+  uint8_t triggered = 0; // bit i: _drivers[i] is measuring
+  uint32_t now = uptimeMillis();
+  uint32_t readyAt = now;
+
+  for (uint8_t i = 0; i < _count; i++) {
+    if ((due & _active[i]) == 0 || !_drivers[i]->trigger(due & _active[i])) {
+      continue;
+    }
+    triggered |= 1 << i;
+    if ((int32_t)(_drivers[i]->readyAt() - readyAt) > 0) {
+      readyAt = _drivers[i]->readyAt();
+    }
+  }
+  if (triggered == 0) {
+    return;
+  }
+
+  // one wait for all of them, the conversions run meanwhile
+  now = uptimeMillis();
+  if ((int32_t)(readyAt - now) > 0) {
+#ifdef IODCLIENT_DEBUG_ON
+    Serial.println(String("Sensors ready in ") + (readyAt - now) + " ms");
+#endif
+    waitMillis(readyAt - now);
+  }
+
+  for (uint8_t i = 0; i < _count; i++) {
+    if (triggered & (1 << i)) {
+      _drivers[i]->read();
+    }
+  }
+  for (uint8_t i = 0; i < _count; i++) {
+    if (triggered & (1 << i)) {
+      _drivers[i]->encode(readings);
+    }
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef SENSOR_REGISTRY
+#define SENSOR_REGISTRY
+
+#include "SensorDriver.hpp"
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define MAX_SENSOR_DRIVERS 4
+#define NO_DRIVER 0xff
+
+// The sensor drivers of the firmware (a new sensor only needs an entry in
+// the table in SensorRegistry.cpp), keyed by the SensorIds in the
+// "activeSensors" of the config. Drivers without active sensors are never
+// triggered or read.
+class SensorRegistry {
+private:
+  SensorDriver *_drivers[MAX_SENSOR_DRIVERS];
+  uint8_t _count;
+  uint8_t _driverOf[SENSOR_COUNT]; // index into _drivers, NO_DRIVER if none
+  uint32_t _active[MAX_SENSOR_DRIVERS]; // active SensorIds per driver
+
+public:
+  SensorRegistry();
+
+  // begins every driver with the config, then keys the active sensors
+  void load(JsonObject &config, JsonArray &activeSensors);
+  SensorDriver *driverOf(uint8_t id);
+
+  // Triggers the drivers of the due sensors (SENSOR_BIT()s), sleeps until
+  // the last of them is ready and collects the values of all of them.
+  void measure(uint32_t due, SensorReadings &readings);
+};
+
+#endif
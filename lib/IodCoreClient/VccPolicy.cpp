@@ -0,0 +1,98 @@
+//#define IODCLIENT_DEBUG_ON 1
+
+#include "VccPolicy.hpp"
+#include "LightSleep.hpp"
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+uint16_t readVccMillivolts() {
+#ifdef VCC_DIVIDER_RATIO
+  return (uint32_t)analogRead(A0) * ADC_FULL_SCALE_MILLIVOLTS *
+         VCC_DIVIDER_RATIO / 1023;
+#else
+  uint16_t millivolts = ESP.getVcc();
+  return millivolts == 0 ? VCC_INVALID : millivolts;
+#endif
+}
+
+VccPolicy::VccPolicy() {
+  _count = 0;
+  _millivolts = 0;
+  _level = -1;
+}
+
+void VccPolicy::load(JsonObject &config, uint16_t lastMillivolts,
+                     uint16_t lastBelowMillivolts) {
+  JsonArray &levels = config["vccLevels"];
+
+  _count = 0;
+  for (uint8_t i = 0; i < levels.size() && _count < MAX_VCC_LEVELS; i++) {
+    JsonObject &entry = levels[i];
+    VccLevel &level = _levels[_count];
+    level.belowMillivolts = entry["belowMillivolts"].as<uint16_t>();
+    level.stretch = constrain(entry["stretch"].as<uint8_t>(), 1,
+                              MAX_VCC_STRETCH); // 1 if missing
+    level.dropped = 0;
+
+    JsonArray &drop = entry["drop"];
+    for (uint8_t j = 0; j < drop.size(); j++) {
+      uint8_t id = sensorId(drop.get<char *>(j));
+      if (id != SENSOR_UNKNOWN) {
+        level.dropped |= SENSOR_BIT(id);
+      }
+    }
+    if (level.belowMillivolts > 0) {
+      _count++;
+    }
+  }
+
+  _millivolts = readVccMillivolts();
+  if (_millivolts == VCC_INVALID) {
+    _millivolts = lastMillivolts;
+  }
+  vccDriver.setMillivolts(_millivolts);
+
+  _level = -1;
+  for (uint8_t i = 0; i < _count && _millivolts > 0; i++) {
+    uint16_t below = _levels[i].belowMillivolts;
+    // entered on an earlier wake: the last level was this one or deeper
+    if (lastBelowMillivolts > 0 && below >= lastBelowMillivolts) {
+      below += VCC_HYSTERESIS_MILLIVOLTS;
+    }
+    if (_millivolts < below &&
+        (_level < 0 ||
+         _levels[i].belowMillivolts < _levels[_level].belowMillivolts)) {
+      _level = i;
+    }
+  }
+
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("VCC ");
+  Serial.print(_millivolts);
+  Serial.print(" mV, level ");
+  Serial.println(_level);
+#endif
+}
+
+uint16_t VccPolicy::belowMillivolts() {
+  return _level < 0 ? 0 : _levels[_level].belowMillivolts;
+}
+
+uint8_t VccPolicy::stretch() {
+  return _level < 0 ? 1 : _levels[_level].stretch;
+}
+
+uint32_t VccPolicy::keep(uint32_t due) {
+  return _level < 0 ? due : due & ~_levels[_level].dropped;
+}
+
+VccDriver vccDriver;
+
+uint32_t VccDriver::readyAt() { return uptimeMillis(); }
+
+void VccDriver::encode(SensorReadings &readings) {
+  if (_millivolts > 0) {
+    readings.add(SENSOR_VCC, _millivolts / 1000.0);
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef VCC_POLICY
+#define VCC_POLICY
+
+#include "SensorDriver.hpp"
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define MAX_VCC_LEVELS 4
+#define MAX_VCC_STRETCH 16
+#define ADC_FULL_SCALE_MILLIVOLTS 1000 // A0 of the bare ESP8266
+#define VCC_INVALID 0xffff // what ESP.getVcc() gives on WAKE_RF_DISABLED
+#define VCC_HYSTERESIS_MILLIVOLTS 50
+
+// The supply in mV, from ESP.getVcc() (the sketch declares
+// ADC_MODE(ADC_VCC)) or, when built with VCC_DIVIDER_RATIO, from a voltage
+// divider to A0 that scales VCC down by that ratio. VCC_INVALID if the ADC
+// could not be read.
+uint16_t readVccMillivolts();
+
+struct VccLevel {
+  uint16_t belowMillivolts;
+  uint8_t stretch;  // of all measurement periods
+  uint32_t dropped; // SensorIds no longer measured, SENSOR_BIT()s
+};
+
+// Battery-aware cadence from the optional "vccLevels" array of the config,
+// e.g. [{"belowMillivolts": 3300, "stretch": 2},
+//       {"belowMillivolts": 3100, "stretch": 4, "drop": ["BME280_DEW"]}].
+// The lowest level that VCC is below applies: its stretch multiplies the
+// measurement periods (so wakes, and with them uploads, get rarer) and its
+// sensors are left out. Above all thresholds nothing changes. A level that
+// was in effect on the last wake is only left once VCC is
+// VCC_HYSTERESIS_MILLIVOLTS above its threshold, so a supply sitting right
+// at a threshold doesn't flip the cadence every wake.
+class VccPolicy {
+private:
+  VccLevel _levels[MAX_VCC_LEVELS];
+  uint8_t _count;
+  uint16_t _millivolts;
+  int8_t _level; // index into _levels, -1 if none applies
+
+public:
+  VccPolicy();
+
+  // Reads the levels and measures VCC, before the radio is on. The last
+  // valid reading and the threshold in effect come from RTC memory, the
+  // reading stands in when the ADC can't be read on this wake.
+  void load(JsonObject &config, uint16_t lastMillivolts,
+            uint16_t lastBelowMillivolts);
+
+  // 0 if there has been no valid reading yet
+  uint16_t millivolts() { return _millivolts; }
+  // of the level in effect, 0 if none
+  uint16_t belowMillivolts();
+  uint8_t stretch();
+  // due without the dropped sensors
+  uint32_t keep(uint32_t due);
+};
+
+// the "VCC" sensor, in V. Reports what VccPolicy::load() measured instead
+// of reading the ADC a second time.
+class VccDriver : public SensorDriver {
+private:
+  uint16_t _millivolts;
+
+public:
+  VccDriver() : _millivolts(0) {}
+
+  uint32_t sensors() { return SENSOR_BIT(SENSOR_VCC); }
+  void begin(JsonObject &config) {}
+  bool trigger(uint32_t due) { return true; }
+  uint32_t readyAt();
+  void read() {}
+  void encode(SensorReadings &readings);
+
+  void setMillivolts(uint16_t millivolts) { _millivolts = millivolts; }
+};
+
+extern VccDriver vccDriver;
+
+#endif
@@ -0,0 +1,27 @@
+//#define IODCLIENT_DEBUG_ON 1
+
+#include "WakePlanner.hpp"
+#include <Arduino.h>
+
+RFMode WakePlanner::radioMode(RtcState &rtc) {
+  // the calibration data survives deep sleep, redoing it only pays off
+  // once temperature or supply voltage had time to drift
+  if (rtc.rfCalCountdown == 0) {
+    rtc.rfCalCountdown = RF_CAL_INTERVAL;
+    return WAKE_RF_DEFAULT;
+  }
+  rtc.rfCalCountdown--;
+  return WAKE_NO_RFCAL;
+}
+
+RFMode WakePlanner::plan(RtcState &rtc, bool deadbands, bool changed,
+                         uint32_t heartbeatDueIn, uint32_t sleepMillis) {
+  bool transmit = !deadbands || changed || heartbeatDueIn <= sleepMillis;
+
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.println(transmit ? "Next wake transmits" : "Next wake only measures");
+#endif
+
+  // a wrong guess is caught in connectToWifi(), which reboots with RF
+  return transmit ? radioMode(rtc) : WAKE_RF_DISABLED;
+}
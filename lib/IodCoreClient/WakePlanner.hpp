@@ -0,0 +1,25 @@
+#ifndef WAKE_PLANNER
+#define WAKE_PLANNER
+
+#include "RtcState.hpp"
+#include <Arduino.h>
+
+#define RF_CAL_INTERVAL 16 // radio wakes between two full RF calibrations
+
+// Decides before going to sleep whether the next wake will transmit, and
+// with that the RF mode to boot it with: no radio at all for wakes that
+// only measure, no RF calibration for most of the wakes that transmit.
+// Everything it has to remember lives in the RtcState.
+class WakePlanner {
+public:
+  // mode for a wake that uses the radio, calibrates every RF_CAL_INTERVAL
+  RFMode radioMode(RtcState &rtc);
+
+  // deadbands: uploads can be skipped at all, changed: a reading left its
+  // deadband during this wake (they tend to keep moving), heartbeatDueIn:
+  // millis until the next forced upload
+  RFMode plan(RtcState &rtc, bool deadbands, bool changed,
+              uint32_t heartbeatDueIn, uint32_t sleepMillis);
+};
+
+#endif
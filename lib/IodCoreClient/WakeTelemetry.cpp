@@ -0,0 +1,38 @@
+#include "WakeTelemetry.hpp"
+#include "LightSleep.hpp"
+#include <Arduino.h>
+
+static const char *phaseNames[PHASE_COUNT] = {
+    "boot",   "eeprom", "parse",   "power",    "sensors",
+    "wifi",   "dns",    "request", "response", "store",
+};
+
+static uint32_t startedAt[PHASE_COUNT];   // micros()
+static uint32_t sleptBefore[PHASE_COUNT]; // lightSleptMillis()
+static uint32_t spent[PHASE_COUNT];       // micros, 0 if not run
+
+const char *phaseName(uint8_t phase) {
+  return phase < PHASE_COUNT ? phaseNames[phase] : "";
+}
+
+void phaseStart(WakePhase phase) {
+  startedAt[phase] = micros();
+  sleptBefore[phase] = lightSleptMillis();
+}
+
+void phaseEnd(WakePhase phase) {
+  // micros() stops in light sleep like millis()
+  spent[phase] += micros() - startedAt[phase] +
+                  (lightSleptMillis() - sleptBefore[phase]) * 1000;
+}
+
+void phaseBoot() { spent[PHASE_BOOT] = micros(); }
+
+void keepPhaseMillis(uint16_t times[PHASE_COUNT]) {
+  for (uint8_t phase = 0; phase < PHASE_COUNT; phase++) {
+    if (spent[phase] > 0) {
+      // rounded up, a phase that ran never reads 0
+      times[phase] = min((spent[phase] + 999) / 1000, (uint32_t)UINT16_MAX);
+    }
+  }
+}
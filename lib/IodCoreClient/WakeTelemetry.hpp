@@ -0,0 +1,36 @@
+#ifndef WAKE_TELEMETRY
+#define WAKE_TELEMETRY
+
+#include <Arduino.h>
+
+// The timed parts of a wake. Never renumber these, they are the keys of the
+// telemetry in CBOR uploads.
+enum WakePhase {
+  PHASE_BOOT = 0,         // core start until setup()
+  PHASE_EEPROM = 1,       // reading the stored config
+  PHASE_CONFIG_PARSE = 2, // parsing it
+  PHASE_POWER_UP = 3,     // power domains settling
+  PHASE_SENSORS = 4,      // trigger, conversion and read back
+  PHASE_WIFI = 5,         // association and DHCP
+  PHASE_DNS = 6,
+  PHASE_REQUEST = 7,      // connect and send, all HTTP requests of the wake
+  PHASE_RESPONSE = 8,     // until the response is read
+  PHASE_CONFIG_STORE = 9, // writing a changed config to the flash
+  PHASE_COUNT
+};
+
+// short JSON key of a phase, "boot", "eeprom", ...
+const char *phaseName(uint8_t phase);
+
+// Stamps cost two micros() reads, so they are always taken, whether the
+// config asks for telemetry or not. Time spent in light sleep is included.
+void phaseStart(WakePhase phase);
+void phaseEnd(WakePhase phase);
+// the boot phase has no start stamp, call first thing in setup()
+void phaseBoot();
+
+// Keeps this wake's phases (in ms, saturated) in times, where they ran. A
+// phase that did not run this wake keeps the time of an earlier one.
+void keepPhaseMillis(uint16_t times[PHASE_COUNT]);
+
+#endif
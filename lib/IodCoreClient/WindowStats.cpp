@@ -0,0 +1,39 @@
+#include "WindowStats.hpp"
+#include <Arduino.h>
+
+void RunningStats::reset() {
+  count = 0;
+  mean = 0;
+  m2 = 0;
+  minimum = NAN;
+  maximum = NAN;
+}
+
+void RunningStats::add(float value) {
+  if (isnan(value)) {
+    return;
+  }
+
+  count++;
+  float delta = value - mean;
+  mean += delta / count;
+  m2 += delta * (value - mean);
+
+  if (count == 1 || value < minimum) {
+    minimum = value;
+  }
+  if (count == 1 || value > maximum) {
+    maximum = value;
+  }
+}
+
+float RunningStats::variance() { return count > 1 ? m2 / (count - 1) : 0; }
+
+void SensorWindow::reset() {
+  for (uint8_t id = 0; id < SENSOR_COUNT; id++) {
+    stats[id].reset();
+  }
+  samples = 0;
+  dropped = 0;
+  time = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef WINDOW_STATS
+#define WINDOW_STATS
+
+#include "SensorReadings.hpp"
+#include <Arduino.h>
+
+// Mean, variance, min and max of a stream of values in constant space.
+// Welford's update keeps the variance stable over thousands of samples.
+struct RunningStats {
+  uint32_t count;
+  float mean;
+  float m2; // sum of squared differences from the mean
+  float minimum;
+  float maximum;
+
+  RunningStats() { reset(); }
+
+  void reset();
+  void add(float value); // nan is skipped
+  float variance();      // sample variance, 0 below two values
+};
+
+// The statistics of every sensor over one upload window.
+struct SensorWindow {
+  RunningStats stats[SENSOR_COUNT];
+  uint32_t samples;
+  uint32_t dropped; // sample ticks missed while the loop was busy
+  uint32_t time;    // seconds since 1970 at the end, 0 if unknown
+
+  SensorWindow() { reset(); }
+
+  void reset();
+  void add(uint8_t id, float value) { stats[id].add(value); }
+};
+
+#endif
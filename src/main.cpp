@@ -1,24 +1,96 @@
 //#define IODCLIENT_DEBUG_ON 1
 //#define ESP8285 // also switch to board=esp8285 in platformio.ini
 
-#include "BME280Handler.hpp"
+#include "ContinuousMode.hpp"
 #include "FeatureHandler.hpp"
 #include "IodCoreClient.hpp"
+#include "PayloadEncoder.hpp"
+#include "SensorReadings.hpp"
+#include "SensorRegistry.hpp"
+#include "VccPolicy.hpp"
+#include "WakeTelemetry.hpp"
 #include "defines.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <FS.h>
 #include <Wire.h>
+#ifdef USING_BRZO
+#include <brzo_i2c.h>
+#endif
+
+#ifndef IOD_MQTT_PORT
+#define IOD_MQTT_PORT 1883 // older defines.h
+#endif
+#ifndef IOD_COAP_PORT
+#define IOD_COAP_PORT 5683
+#endif
+#ifdef ESP8285
+#define I2C_SDA 4
+#define I2C_SCL 14
+#else
+#define I2C_SDA SDA
+#define I2C_SCL SCL
+#endif
+#define BRZO_STRETCH_TIMEOUT_MICROS 2000
+#if defined(IOD_TLS) && !defined(IOD_TLS_FINGERPRINT)
+#define IOD_TLS_FINGERPRINT NULL // encrypted, but the server is not verified
+#endif
+
+#ifndef VCC_DIVIDER_RATIO
+ADC_MODE(ADC_VCC); // ESP.getVcc(), A0 is not connected then
+#endif
 
-IoDCoreClient client = IoDCoreClient(WIFI_SSID, WIFI_PASS, IOD_CORE_HOST,
-                                     IOD_CORE_PORT, IOD_USER, IOD_PASS);
+IoDCoreClient client =
+    IoDCoreClient(WIFI_SSID, WIFI_PASS, IOD_CORE_HOST, IOD_CORE_PORT, IOD_USER,
+                  IOD_PASS, IOD_MQTT_PORT, IOD_COAP_PORT);
+
+static char uuidString[16 * 2 + 4 + 1];
+static PayloadTemplate payloadTemplate;
+static bool hasTemplate = false;
+static ContinuousMode continuous;
+static SensorRegistry sensorRegistry;
+static VccPolicy vccPolicy;
+// static, like the client's response buffer: the cont stack only has 4 KB
+static char bootConfig[MAX_CONFIG_SIZE];
+
+static JsonObject &loadConfig(char *json) {
+  phaseStart(PHASE_EEPROM);
+  uint32_t len = client.getConfigLength(EEPROM);
+  client.getConfigString(EEPROM, json,
+                         min(len, (uint32_t)(MAX_CONFIG_SIZE - CONFIG_OFFSET)));
+  phaseEnd(PHASE_EEPROM);
+
+#ifdef IODCLIENT_DEBUG_ON
+  Serial.print("Loaded config: ");
+  Serial.println(json);
+#endif
+
+  phaseStart(PHASE_CONFIG_PARSE);
+  JsonObject &config = client.jsonArena().parseObject(json);
+  phaseEnd(PHASE_CONFIG_PARSE);
+  client.logJsonArena("config parse");
+#ifdef IODCLIENT_DEBUG_ON
+  if (!config.success()) {
+    Serial.println("Stored config does not parse, JSON arena full?");
+  }
+#endif
+  return config;
+}
+
+// a config of this node with at least one sensor or feature
+static bool hasTasks(JsonObject &config, const char *uuidString) {
+  JsonArray &features = config["activeFeatures"];
+  JsonArray &sensors = config["activeSensors"];
+  return String(config["id"].as<char *>()).equals(uuidString) &&
+         (features.size() > 0 || sensors.size() > 0);
+}
 
 // 0. Boot/Wakeup
 void setup() {
-#ifdef ESP8285
-  Wire.begin(4, 14);
-#else
-  Wire.begin();
+  phaseBoot();
+  Wire.begin(I2C_SDA, I2C_SCL);
+#ifdef USING_BRZO
+  brzo_i2c_setup(I2C_SDA, I2C_SCL, BRZO_STRETCH_TIMEOUT_MICROS);
 #endif
 
 #ifdef IODCLIENT_DEBUG_ON
@@ -28,9 +100,12 @@ void setup() {
 #endif
 
   EEPROM.begin(MAX_CONFIG_SIZE);
+  client.loadState();
+#ifdef IOD_TLS
+  client.useTls(IOD_TLS_FINGERPRINT);
+#endif
 
   uint8_t uuid[16];
-  char uuidString[16 * 2 + 4 + 1];
 
   // 1. Check if node has UUID
   if (!client.hasUUID(EEPROM)) {
@@ -46,101 +121,214 @@ void setup() {
   Serial.println(uuidString);
 #endif
 
-  // read configuration
-  uint32_t len = client.getConfigLength(EEPROM);
-  char bootConfig[len + 1];
-  client.getConfigString(EEPROM, bootConfig, len);
+  // read configuration, careful: the arena and bootConfig are reused when a
+  // config response gets parsed, the boot config must not be touched after
+  // talking to the server.
+  client.setConfigBuffer(bootConfig);
+  JsonObject *parsedConfig = &loadConfig(bootConfig);
 
+  // 2. Without a usable config, provision now and carry on with the new one
+  // in this wake (and over the same connection) instead of sleeping first
+  if (!hasTasks(*parsedConfig, uuidString)) {
+    // storing parses into the reset arena, even when it fails, so the boot
+    // config is loaded again whatever the result
+    client.updateConfig(EEPROM, uuidString);
+    client.resetJsonArena();
+    parsedConfig = &loadConfig(bootConfig);
+
+    if (!hasTasks(*parsedConfig, uuidString)) {
 #ifdef IODCLIENT_DEBUG_ON
-  Serial.print("Loaded config: ");
-  Serial.println(bootConfig);
+      Serial.println(String("No tasks yet, trying again in ") +
+                     String(DEEP_SLEEP_MINUTES) + " minutes");
 #endif
+      client.deepSleep(1000ULL * 1000 * 60 * DEEP_SLEEP_MINUTES,
+                       WAKE_RF_DEFAULT);
+    }
+  }
 
-  DynamicJsonBuffer jsonBuffer(2048);
-  JsonObject &bootConfigJson = jsonBuffer.parseObject(bootConfig);
+  JsonObject &bootConfigJson = *parsedConfig;
+  JsonArray &features = bootConfigJson["activeFeatures"];
+  JsonArray &sensors = bootConfigJson["activeSensors"];
+  sensorRegistry.load(bootConfigJson, sensors);
 
-  // 2. Check if there is a local config
-  if (String(bootConfigJson["id"].as<char *>()).equals(uuidString)) {
+#ifdef IODCLIENT_DEBUG_ON
+  for (JsonVariant feature : features) {
+    Serial.print("Feature: ");
+    Serial.println(feature.as<char *>());
+  }
+  for (JsonVariant sensor : sensors) {
+    Serial.print("Sensor: ");
+    Serial.println(sensor.as<char *>());
+  }
+#endif
 
-    JsonArray &features = bootConfigJson["activeFeatures"];
-    JsonArray &sensors = bootConfigJson["activeSensors"];
+  // handle tasks
 
-    // first check if we have something todo:
-#ifdef IODCLIENT_DEBUG_ON
-    for (JsonVariant feature : features) {
-      Serial.print("Feature: ");
-      Serial.println(feature.as<char *>());
-    }
-    for (JsonVariant sensor : sensors) {
-      Serial.print("Sensor: ");
-      Serial.println(sensor.as<char *>());
+  client.setTransport(
+      transportFromString(bootConfigJson["transport"].as<char *>()),
+      bootConfigJson["mqttCleanSession"].as<bool>(),
+      bootConfigJson.containsKey("coapRetransmits")
+          ? bootConfigJson["coapRetransmits"].as<uint8_t>()
+          : COAP_MAX_RETRANSMIT);
+  client.setTelemetry(bootConfigJson["telemetry"].as<bool>());
+
+  // the payload shape is known from the config alone
+  JsonVariant dataId = bootConfigJson["dataId"].as<JsonVariant>();
+  uint8_t decimals[SENSOR_COUNT];
+  loadPrecision(bootConfigJson, decimals);
+
+  hasTemplate = payloadTemplate.build(dataId, sensors, decimals);
+
+  if (ContinuousMode::isEnabled(bootConfigJson)) {
+    continuous.load(bootConfigJson, sensors);
+    handleFeaturesBeforeSensors(&client, bootConfigJson, features);
+    if (continuous.begin()) {
+      client.connectToWifi();
+      return; // loop() takes over
     }
-#endif
+    client.deepSleep(1000ULL * 1000 * 60 * DEEP_SLEEP_MINUTES,
+                     WAKE_RF_DEFAULT);
+  }
 
-    if (features.size() == 0 && sensors.size() == 0) {
-      // in case the config is empty, try to get an updated one.
-      if (client.updateConfig(EEPROM, uuidString)) {
+  SensorReadings readings;
+  uint32_t sleepTimeMillis = bootConfigJson["sleepTimeMillis"];
+  // a low battery stretches the cadence and leaves sensors out
+  vccPolicy.load(bootConfigJson, client.lastVccMillivolts(),
+                 client.lastVccBelowMillivolts());
+  client.rememberVcc(vccPolicy.millivolts(), vccPolicy.belowMillivolts());
+  uint32_t due = vccPolicy.keep(client.dueSensors(
+      bootConfigJson, sensors, sleepTimeMillis, vccPolicy.stretch()));
+
+  handleFeaturesBeforeSensors(&client, bootConfigJson, features);
+  phaseStart(PHASE_SENSORS);
+  sensorRegistry.measure(due, readings);
+  phaseEnd(PHASE_SENSORS);
+  readings.time = client.epochNow();
+  handleFeaturesAfterSensors(&client, bootConfigJson, features);
+
+  if (!client.isWorthSending(bootConfigJson, readings)) {
 #ifdef IODCLIENT_DEBUG_ON
-        Serial.println("Got updated config from server");
-        Serial.println(String("Will sleep now for ") +
-                       String(DEEP_SLEEP_MINUTES) + " minutes");
+    Serial.println("Readings within deadband, skipping upload");
 #endif
-        ESP.deepSleep(1000 * 1000 * 60 * DEEP_SLEEP_MINUTES, WAKE_RF_DEFAULT);
-      } else {
+    client.rememberMeasured(readings);
+    client.sleepUntilNextWake(client.wakePeriod(), uuidString);
+  }
+
+  bool useCbor =
+      String(bootConfigJson["uploadFormat"].as<char *>()).equals("cbor");
+  int code = HTTP_UNSUPPORTED_MEDIA_TYPE;
+
+  // without radio this reboots into a radio wake, which has to find the
+  // same sensors due and measure them again
+  client.connectToWifi();
+  client.rememberMeasured(readings);
+
+  if (useCbor && client.acceptsCbor()) {
+    uint8_t body[MAX_CBOR_PAYLOAD_SIZE];
+    size_t length =
+        encodeCborPayload(body, sizeof(body), dataId, readings, decimals,
+                          client.telemetry());
+
 #ifdef IODCLIENT_DEBUG_ON
-        Serial.println(String("Update failed, trying again in ") +
-                       String(DEEP_SLEEP_MINUTES) + " minutes");
+    Serial.println(String("SensorData: CBOR, ") + length + " bytes");
 #endif
-        ESP.deepSleep(1000 * 1000 * 60 * DEEP_SLEEP_MINUTES, WAKE_RF_DEFAULT);
-      }
+
+    if (length > 0) {
+      code = client.postValues(EEPROM, CBOR_CONTENT_TYPE, body, length,
+                               uuidString);
     }
-    // handle tasks
+  }
 
-    JsonObject &payLoad = jsonBuffer.createObject();
-    payLoad["dataId"] = bootConfigJson["dataId"];
-    JsonObject &sensorData = payLoad.createNestedObject("values");
+  if (code == HTTP_UNSUPPORTED_MEDIA_TYPE) {
+    // JSON is the default, and the fallback for servers without CBOR
+    char body[MAX_JSON_PAYLOAD_SIZE] = "";
+    size_t length = 0;
 
-    handleFeaturesBeforeSensors(&client, jsonBuffer, features);
-    handleBME280(&client, jsonBuffer, sensorData, sensors, features);
-    handleFeaturesAfterSensors(&client, jsonBuffer, features);
+    if (hasTemplate) {
+      length = payloadTemplate.render(readings, body, sizeof(body),
+                                      client.telemetry());
+    }
 
 #ifdef IODCLIENT_DEBUG_ON
-    String output;
-    sensorData.printTo(output);
-    Serial.println("SensorData: " + output);
+    Serial.println(String("SensorData: ") + body);
 #endif
 
-    client.connectToWifi();
-    client.postValues(EEPROM, payLoad, uuidString);
+    if (length > 0) {
+      code = client.postValues(EEPROM, JSON_CONTENT_TYPE, (uint8_t *)body,
+                               length, uuidString);
+    }
+  }
+
+  // 2xx, or 304 for values the server already has; other 3xx are no upload
+  if ((code >= HTTP_OK && code < 300) || code == HTTP_NOT_MODIFIED) {
+    client.rememberUpload(readings);
+  }
 
 #ifdef IODCLIENT_DEBUG_ON
-    Serial.println("GoodNight");
+  Serial.println(String("JSON arena peak: ") + client.jsonArenaPeak() +
+                 " of " + JSON_ARENA_SIZE + " bytes");
+  Serial.println("GoodNight");
 #endif
 
-    ESP.deepSleep(1000 * bootConfigJson["sleepTimeMillis"].as<uint32_t>(),
-                  WAKE_RF_DEFAULT);
+  client.sleepUntilNextWake(client.wakePeriod(), uuidString);
+
+  // TODO: advanced implementation ( |: measure, cache :| and send)
+}
+
+// Starts the upload of the oldest queued window. After a failed start the
+// window stays queued and the next try waits for the next window.
+static bool uploadFailed = false;
+
+static void uploadQueuedWindow() {
+  SensorWindow *window = continuous.queuedWindow();
+  if (window == NULL || uploadFailed) {
+    return;
+  }
+
+  char body[MAX_WINDOW_PAYLOAD_SIZE] = "";
+  size_t length =
+      hasTemplate ? payloadTemplate.renderWindow(*window, body, sizeof(body))
+                  : 0;
 
-    // TODO: advanced implementation ( |: measure, cache :| and send)
-  } else {
-    if (client.updateConfig(EEPROM, uuidString)) {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println("Got initial config from server");
-      Serial.println("Will sleep now for 10 seconds ");
+  Serial.println(String("SensorData: ") + body);
 #endif
-      ESP.deepSleep(1000 * 1000 * 10, WAKE_RF_DEFAULT);
-    } else {
+
+  if (length == 0) {
+    continuous.windowSent(); // can never be sent
+    return;
+  }
+  if (WiFi.status() != WL_CONNECTED) {
+    client.connectToWifi();
+  }
+  // the HTTP connection is kept alive from one window to the next
+  uploadFailed = !client.postValuesAsync(EEPROM, JSON_CONTENT_TYPE,
+                                         (uint8_t *)body, length, uuidString);
+  if (uploadFailed) {
 #ifdef IODCLIENT_DEBUG_ON
-      Serial.println(String("Fetch failed, trying again in ") +
-                     String(DEEP_SLEEP_MINUTES) + " minutes");
+    Serial.println("Upload failed, window stays queued");
 #endif
-      ESP.deepSleep(1000 * 1000 * 60 * DEEP_SLEEP_MINUTES, WAKE_RF_DEFAULT);
-    }
+    return;
   }
-
-  // TODO: sleep for 3 minutes
+  continuous.windowSent();
 }
 
 void loop(void) {
-  // There is no loop, this program will only execute once and go back to
-  // sleep.
-}
\ No newline at end of file
+  // only continuous mode gets here, otherwise setup() ends in deep sleep
+  bool uploading = client.pollUpload();
+
+  // sampling goes on while the server answers, complete windows wait in
+  // the queue
+  if (continuous.collect()) {
+    continuous.window().time = client.epochNow();
+    continuous.nextWindow();
+    uploadFailed = false;
+  }
+  if (!uploading) {
+    uploadQueuedWindow();
+  }
+
+  if (client.configStored()) {
+    ESP.restart(); // start over with the new config
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef NATIVE_ARDUINO
+#define NATIVE_ARDUINO
+
+// Just enough of the Arduino core to build the protocol code on the host.
+// Time only moves in delay(), so timeouts run without waiting.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef uint8_t byte;
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#endif
+#define bit(b) (1UL << (b))
+
+inline unsigned long &nativeMillis() {
+  static unsigned long now = 0;
+  return now;
+}
+
+// the RTC keeps running in light sleep, the timer behind millis() does not
+inline unsigned long long &nativeRtcMicros() {
+  static unsigned long long now = 0;
+  return now;
+}
+
+// a forced light sleep armed by the SDK (user_interface.h), it starts when
+// the CPU idles in the next delay()
+inline unsigned long &nativeArmedSleep() {
+  static unsigned long ms = 0;
+  return ms;
+}
+
+inline unsigned long millis() { return nativeMillis(); }
+inline unsigned long micros() { return nativeMillis() * 1000; }
+inline void delay(unsigned long ms) {
+  unsigned long asleep = min(nativeArmedSleep(), ms);
+  nativeArmedSleep() = 0;
+  nativeMillis() += ms - asleep;
+  nativeRtcMicros() += ms * 1000ULL;
+}
+inline void yield() {}
+
+// the 512 bytes of RTC user memory, kept while the host "deep sleeps"
+class EspClass {
+  uint32_t _rtcMemory[128];
+
+public:
+  bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size) {
+    if (offset * 4 + size > sizeof(_rtcMemory)) {
+      return false;
+    }
+    memcpy(data, _rtcMemory + offset, size);
+    return true;
+  }
+  bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size) {
+    if (offset * 4 + size > sizeof(_rtcMemory)) {
+      return false;
+    }
+    memcpy(_rtcMemory + offset, data, size);
+    return true;
+  }
+};
+static EspClass ESP __attribute__((unused));
+
+inline long random(long howBig) { return howBig > 0 ? rand() % howBig : 0; }
+inline long random(long howSmall, long howBig) {
+  return howSmall + random(howBig - howSmall);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef NATIVE_CLIENT
+#define NATIVE_CLIENT
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class Client {
+public:
+  virtual ~Client() {}
+
+  virtual int connect(IPAddress ip, uint16_t port) = 0;
+  virtual int connect(const char *host, uint16_t port) = 0;
+  virtual size_t write(uint8_t b) { return write(&b, 1); }
+  virtual size_t write(const uint8_t *buf, size_t size) = 0;
+  virtual size_t availableForWrite() { return 0; }
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int read(uint8_t *buf, size_t size) = 0;
+  virtual int peek() { return -1; }
+  virtual void flush() {}
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+};
+
+#endif
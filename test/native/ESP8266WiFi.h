@@ -0,0 +1,7 @@
+#ifndef NATIVE_ESP8266_WIFI
+#define NATIVE_ESP8266_WIFI
+
+#include <Client.h>
+#include <IPAddress.h>
+
+#endif
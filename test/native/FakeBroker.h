@@ -0,0 +1,194 @@
+#ifndef FAKE_BROKER
+#define FAKE_BROKER
+
+#include <Client.h>
+
+#define FAKE_MAX_PACKET 512
+#define FAKE_MAX_PUBLISHED 4
+
+// An MQTT 3.1.1 broker on the other end of the connection, just enough for
+// one client: it answers CONNECT, SUBSCRIBE and QoS1 PUBLISH as they are
+// written and keeps the session (the subscription) across connections
+// unless the client asks for a clean one. A retained message on the
+// subscribed topic is delivered after the SUBACK, like real brokers do.
+class FakeBroker : public Client {
+public:
+  uint8_t subscribeCode; // SUBACK return code, 0x80 refuses
+  const char *retainedTopic;
+  const char *retainedMessage;
+
+  uint8_t connects;
+  uint8_t subscribes;
+  bool subscribed; // in the session
+  uint8_t published;
+  char publishedTopics[FAKE_MAX_PUBLISHED][64];
+  char publishedPayloads[FAKE_MAX_PUBLISHED][128];
+
+private:
+  bool _session;
+  bool _open;
+  uint8_t _in[FAKE_MAX_PACKET];
+  size_t _inLength;
+  uint8_t _out[FAKE_MAX_PACKET];
+  size_t _outLength;
+  size_t _outPos;
+
+  void send(const uint8_t *packet, size_t length) {
+    memcpy(_out + _outLength, packet, length);
+    _outLength += length;
+  }
+
+  static size_t readString(const uint8_t *buf, char *out, size_t size) {
+    size_t length = (buf[0] << 8) | buf[1];
+    size_t n = min(length, size - 1);
+    memcpy(out, buf + 2, n);
+    out[n] = 0;
+    return length + 2;
+  }
+
+  void onConnect(const uint8_t *body) {
+    bool clean = body[7] & 0x02;
+    if (clean) {
+      _session = false;
+      subscribed = false;
+    }
+    const uint8_t connack[] = {0x20, 0x02, (uint8_t)(_session ? 1 : 0), 0};
+    send(connack, sizeof(connack));
+    _session = true;
+  }
+
+  void onSubscribe(const uint8_t *body) {
+    char topic[64];
+    readString(body + 2, topic, sizeof(topic));
+    subscribes++;
+    const uint8_t suback[] = {0x90, 0x03, body[0], body[1], subscribeCode};
+    send(suback, sizeof(suback));
+    if (subscribeCode == 0x80) {
+      return;
+    }
+    subscribed = true;
+
+    if (retainedTopic != NULL && strcmp(topic, retainedTopic) == 0) {
+      size_t topicLength = strlen(retainedTopic);
+      size_t length = strlen(retainedMessage);
+      uint8_t publish[FAKE_MAX_PACKET];
+      size_t n = 0;
+      publish[n++] = 0x33; // QoS1, retained
+      publish[n++] = 2 + topicLength + 2 + length; // below 128
+      publish[n++] = 0;
+      publish[n++] = topicLength;
+      memcpy(publish + n, retainedTopic, topicLength);
+      n += topicLength;
+      publish[n++] = 0;
+      publish[n++] = 1;
+      memcpy(publish + n, retainedMessage, length);
+      n += length;
+      send(publish, n);
+    }
+  }
+
+  void onPublish(const uint8_t *body, size_t remaining) {
+    uint8_t i = published < FAKE_MAX_PUBLISHED ? published++ : 0;
+    size_t n = readString(body, publishedTopics[i], 64);
+    uint8_t id[2] = {body[n], body[n + 1]};
+    n += 2;
+    size_t length = min(remaining - n, (size_t)127);
+    memcpy(publishedPayloads[i], body + n, length);
+    publishedPayloads[i][length] = 0;
+
+    const uint8_t puback[] = {0x40, 0x02, id[0], id[1]};
+    send(puback, sizeof(puback));
+  }
+
+  // handles every complete packet written so far
+  void process() {
+    while (_inLength >= 2) {
+      size_t remaining = 0;
+      size_t n = 1;
+      uint8_t shift = 0;
+      do {
+        if (n >= _inLength) {
+          return;
+        }
+        remaining |= (size_t)(_in[n] & 0x7f) << shift;
+        shift += 7;
+      } while (_in[n++] & 0x80);
+      if (n + remaining > _inLength) {
+        return;
+      }
+
+      const uint8_t *body = _in + n;
+      switch (_in[0] & 0xf0) {
+      case 0x10:
+        onConnect(body);
+        break;
+      case 0x80:
+        onSubscribe(body);
+        break;
+      case 0x30:
+        onPublish(body, remaining);
+        break;
+      case 0xe0:
+        _open = false;
+        break;
+      default:
+        break; // PUBACK of the retained message
+      }
+
+      _inLength -= n + remaining;
+      memmove(_in, _in + n + remaining, _inLength);
+    }
+  }
+
+public:
+  FakeBroker() { reset(); }
+
+  void reset() {
+    subscribeCode = 0x01;
+    retainedTopic = NULL;
+    retainedMessage = NULL;
+    connects = 0;
+    subscribes = 0;
+    subscribed = false;
+    published = 0;
+    _session = false;
+    _open = false;
+    _inLength = 0;
+    _outLength = 0;
+    _outPos = 0;
+  }
+
+  int connect(IPAddress ip, uint16_t port) { return connect("", port); }
+  int connect(const char *host, uint16_t port) {
+    connects++;
+    _open = true;
+    _inLength = 0;
+    _outLength = 0;
+    _outPos = 0;
+    return 1;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) {
+    if (!_open || _inLength + size > sizeof(_in)) {
+      return 0;
+    }
+    memcpy(_in + _inLength, buf, size);
+    _inLength += size;
+    process();
+    return size;
+  }
+
+  int available() { return _outLength - _outPos; }
+  int read() { return _outPos < _outLength ? _out[_outPos++] : -1; }
+  int read(uint8_t *buf, size_t size) {
+    size_t n = min(size, _outLength - _outPos);
+    memcpy(buf, _out + _outPos, n);
+    _outPos += n;
+    return n;
+  }
+
+  void stop() { _open = false; }
+  uint8_t connected() { return _open; }
+};
+
+#endif
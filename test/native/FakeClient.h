@@ -0,0 +1,91 @@
+#ifndef FAKE_CLIENT
+#define FAKE_CLIENT
+
+#include <Client.h>
+
+#define FAKE_MAX_CONNECTIONS 4
+#define FAKE_MAX_DATA 1024
+
+// A server that answers every connection with a prepared byte stream.
+// Connection n gets responses[n], writes are recorded in sent.
+class FakeClient : public Client {
+public:
+  const char *responses[FAKE_MAX_CONNECTIONS];
+  size_t responseLengths[FAKE_MAX_CONNECTIONS]; // 0: strlen()
+  uint8_t connects;
+  bool dropOnWrite; // the server closed the idle connection meanwhile
+  unsigned long latency; // ms for a round trip, the handshake takes one
+
+  uint8_t sent[FAKE_MAX_DATA];
+  size_t sentLength;
+
+private:
+  const uint8_t *_rx;
+  size_t _rxLength;
+  size_t _pos;
+  bool _open;
+  unsigned long _readyAt; // the response arrives
+
+public:
+  FakeClient() { reset(); }
+
+  void reset() {
+    memset(responses, 0, sizeof(responses));
+    memset(responseLengths, 0, sizeof(responseLengths));
+    connects = 0;
+    dropOnWrite = false;
+    latency = 0;
+    sentLength = 0;
+    _rx = NULL;
+    _rxLength = 0;
+    _pos = 0;
+    _open = false;
+    _readyAt = 0;
+  }
+
+  int connect(IPAddress ip, uint16_t port) { return connect("", port); }
+  int connect(const char *host, uint16_t port) {
+    if (connects >= FAKE_MAX_CONNECTIONS || responses[connects] == NULL) {
+      return 0;
+    }
+    delay(latency);
+    _rx = (const uint8_t *)responses[connects];
+    _rxLength = responseLengths[connects] > 0 ? responseLengths[connects]
+                                              : strlen(responses[connects]);
+    _pos = 0;
+    _open = true;
+    connects++;
+    return 1;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) {
+    if (dropOnWrite) {
+      dropOnWrite = false;
+      _open = false;
+      _pos = _rxLength;
+    }
+    if (!_open) {
+      return 0;
+    }
+    size_t n = min(size, sizeof(sent) - sentLength);
+    memcpy(sent + sentLength, buf, n);
+    sentLength += n;
+    _readyAt = millis() + latency;
+    return size;
+  }
+  size_t availableForWrite() { return _open ? 64 : 0; }
+
+  int available() { return millis() < _readyAt ? 0 : _rxLength - _pos; }
+  int read() { return available() > 0 ? _rx[_pos++] : -1; }
+  int read(uint8_t *buf, size_t size) {
+    size_t n = min(size, (size_t)available());
+    memcpy(buf, _rx + _pos, n);
+    _pos += n;
+    return n;
+  }
+
+  void stop() { _open = false; }
+  uint8_t connected() { return _open || _pos < _rxLength; }
+};
+
+#endif
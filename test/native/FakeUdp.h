@@ -0,0 +1,101 @@
+#ifndef FAKE_UDP
+#define FAKE_UDP
+
+#include <Udp.h>
+
+#define FAKE_MAX_DATAGRAM 512
+
+// Keeps the last datagram sent. With a response code set, every request is
+// answered by a piggybacked ACK that echoes its message id and token.
+class FakeUdp : public UDP {
+public:
+  uint8_t sent[FAKE_MAX_DATAGRAM];
+  size_t sentLength;
+  uint8_t packets;
+  unsigned long latency; // ms until the response arrives
+
+  uint8_t responseCode; // 0: stay silent
+  const uint8_t *responseOptions; // encoded options behind the token
+  size_t responseOptionsLength;
+  const char *responsePayload;
+
+private:
+  uint8_t _rx[FAKE_MAX_DATAGRAM];
+  size_t _rxLength;
+  size_t _pending;
+  unsigned long _readyAt;
+
+public:
+  FakeUdp() { reset(); }
+
+  void reset() {
+    sentLength = 0;
+    packets = 0;
+    latency = 0;
+    responseCode = 0;
+    responseOptions = NULL;
+    responseOptionsLength = 0;
+    responsePayload = NULL;
+    _rxLength = 0;
+    _pending = 0;
+    _readyAt = 0;
+  }
+
+  int beginPacket(IPAddress ip, uint16_t port) { return beginPacket("", port); }
+  int beginPacket(const char *host, uint16_t port) {
+    sentLength = 0;
+    return 1;
+  }
+  size_t write(const uint8_t *buf, size_t size) {
+    size_t n = min(size, sizeof(sent) - sentLength);
+    memcpy(sent + sentLength, buf, n);
+    sentLength += n;
+    return n;
+  }
+  int endPacket() {
+    packets++;
+    if (responseCode == 0 || sentLength < 4) {
+      return 1;
+    }
+
+    uint8_t tokenLength = sent[0] & 0x0f;
+    size_t n = 0;
+    _rx[n++] = 0x60 | tokenLength; // version 1, ACK
+    _rx[n++] = responseCode;
+    _rx[n++] = sent[2];
+    _rx[n++] = sent[3];
+    memcpy(_rx + n, sent + 4, tokenLength);
+    n += tokenLength;
+    if (responseOptions != NULL) {
+      memcpy(_rx + n, responseOptions, responseOptionsLength);
+      n += responseOptionsLength;
+    }
+    if (responsePayload != NULL) {
+      _rx[n++] = 0xff;
+      memcpy(_rx + n, responsePayload, strlen(responsePayload));
+      n += strlen(responsePayload);
+    }
+    _rxLength = n;
+    _pending = n;
+    _readyAt = millis() + latency;
+    return 1;
+  }
+
+  int parsePacket() {
+    if (millis() < _readyAt) {
+      return 0;
+    }
+    int size = _pending;
+    _pending = 0;
+    return size;
+  }
+  int read(uint8_t *buf, size_t size) {
+    size_t n = min(size, _rxLength);
+    memcpy(buf, _rx, n);
+    return n;
+  }
+  IPAddress remoteIP() { return IPAddress(1); }
+  uint16_t remotePort() { return 5683; }
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef NATIVE_IP_ADDRESS
+#define NATIVE_IP_ADDRESS
+
+#include <Arduino.h>
+
+class IPAddress {
+private:
+  uint32_t _address;
+
+public:
+  IPAddress() : _address(0) {}
+  IPAddress(uint32_t address) : _address(address) {}
+
+  bool isSet() const { return _address != 0; }
+  operator uint32_t() const { return _address; }
+};
+
+#endif
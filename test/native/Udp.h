@@ -0,0 +1,21 @@
+#ifndef NATIVE_UDP
+#define NATIVE_UDP
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+class UDP {
+public:
+  virtual ~UDP() {}
+
+  virtual int beginPacket(IPAddress ip, uint16_t port) = 0;
+  virtual int beginPacket(const char *host, uint16_t port) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) = 0;
+  virtual int endPacket() = 0;
+  virtual int parsePacket() = 0;
+  virtual int read(uint8_t *buf, size_t size) = 0;
+  virtual IPAddress remoteIP() = 0;
+  virtual uint16_t remotePort() = 0;
+};
+
+#endif
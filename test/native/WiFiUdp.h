@@ -0,0 +1,6 @@
+#ifndef NATIVE_WIFI_UDP
+#define NATIVE_WIFI_UDP
+
+#include <Udp.h>
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef NATIVE_GPIO
+#define NATIVE_GPIO
+
+#include <stdint.h>
+
+#define GPIO_ID_PIN(n) (n)
+#define GPIO_PIN_INTR_LOLEVEL 4
+#define GPIO_PIN_INTR_HILEVEL 5
+
+inline void gpio_pin_wakeup_enable(uint32_t pin, int level) {}
+inline void gpio_pin_wakeup_disable() {}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef NATIVE_USER_INTERFACE
+#define NATIVE_USER_INTERFACE
+
+#include <Arduino.h>
+
+// The parts of the SDK behind forced light sleep. A sleep armed with
+// wifi_fpm_do_sleep() starts in the next delay() and lasts until its timer
+// runs out, unless OS timers are pending: then the SDK only modem-sleeps.
+
+#define NULL_MODE 0
+#define LIGHT_SLEEP_T 1
+
+typedef struct _os_timer_t {
+  struct _os_timer_t *timer_next;
+  uint32_t timer_expire;
+} os_timer_t;
+
+extern os_timer_t *timer_list;
+
+inline bool wifi_set_opmode_current(uint8_t mode) { return true; }
+inline void wifi_fpm_set_sleep_type(uint8_t type) {}
+inline void wifi_fpm_open() {}
+inline void wifi_fpm_close() {}
+
+inline int8_t wifi_fpm_do_sleep(uint32_t us) {
+  if (timer_list == NULL) {
+    nativeArmedSleep() = us / 1000;
+  }
+  return 0;
+}
+
+// one tick per microsecond, the calibration is 1.0 in Q12
+inline uint32_t system_get_rtc_time() { return nativeRtcMicros(); }
+inline uint32_t system_rtc_clock_cali_proc() { return 1 << 12; }
+
+#endif
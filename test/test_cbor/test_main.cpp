@@ -0,0 +1,268 @@
+// the library as a whole needs the ESP8266 core, only the units under test
+// are built on the host
+#include "CborWriter.cpp"
+#include "FixedPoint.cpp"
+#include "PayloadEncoder.cpp"
+#include "SensorReadings.cpp"
+#include "WindowStats.cpp"
+#include <time.h>
+#include <unity.h>
+
+// wake telemetry is not under test here
+const char *phaseName(uint8_t phase) { return "wifi"; }
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint8_t buf[32];
+
+void test_integer_heads(void) {
+  CborWriter cbor(buf, sizeof(buf));
+  cbor.writeUInt(23);
+  cbor.writeUInt(24);
+  cbor.writeUInt(500);
+  cbor.writeUInt(70000);
+  const uint8_t expected[] = {0x17, 0x18, 0x18, 0x19, 0x01,
+                              0xf4, 0x1a, 0x00, 0x01, 0x11, 0x70};
+  TEST_ASSERT_EQUAL(sizeof(expected), cbor.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_negative_integers(void) {
+  CborWriter cbor(buf, sizeof(buf));
+  cbor.writeInt(-1);
+  cbor.writeInt(-500);
+  cbor.writeInt(10);
+  const uint8_t expected[] = {0x20, 0x39, 0x01, 0xf3, 0x0a};
+  TEST_ASSERT_EQUAL(sizeof(expected), cbor.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_containers_and_text(void) {
+  CborWriter cbor(buf, sizeof(buf));
+  cbor.writeMap(2);
+  cbor.writeArray(3);
+  cbor.writeText("abc");
+  cbor.writeNull();
+  const uint8_t expected[] = {0xa2, 0x83, 0x63, 'a', 'b', 'c', 0xf6};
+  TEST_ASSERT_EQUAL(sizeof(expected), cbor.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_decimal_fraction(void) {
+  CborWriter cbor(buf, sizeof(buf));
+  cbor.writeDecimal(23.45f, 2);
+  cbor.writeDecimal(-7.0f, 0);
+  cbor.writeDecimal(NAN, 2);
+  // 4([-2, 2345]), -7, null
+  const uint8_t expected[] = {0xc4, 0x82, 0x21, 0x19, 0x09, 0x29, 0x26, 0xf6};
+  TEST_ASSERT_EQUAL(sizeof(expected), cbor.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buf, sizeof(expected));
+}
+
+void test_overflow(void) {
+  CborWriter cbor(buf, 2);
+  cbor.writeText("abc");
+  TEST_ASSERT_TRUE(cbor.overflowed());
+  TEST_ASSERT_EQUAL(2, cbor.size());
+}
+
+// Just enough of a CBOR decoder to read the payloads back.
+class CborReader {
+private:
+  const uint8_t *_buf;
+  size_t _size;
+  size_t _pos;
+
+public:
+  CborReader(const uint8_t *buf, size_t size)
+      : _buf(buf), _size(size), _pos(0) {}
+
+  bool atEnd() { return _pos == _size; }
+
+  uint32_t readHead(uint8_t &major) {
+    TEST_ASSERT_TRUE(_pos < _size);
+    uint8_t initial = _buf[_pos++];
+    major = initial >> 5;
+    uint8_t info = initial & 0x1f;
+    if (info < 24 || major == 7) {
+      return info;
+    }
+    uint8_t bytes = 1 << (info - 24);
+    TEST_ASSERT_TRUE(bytes <= 4 && _pos + bytes <= _size);
+    uint32_t value = 0;
+    while (bytes-- > 0) {
+      value = value << 8 | _buf[_pos++];
+    }
+    return value;
+  }
+
+  uint32_t readUInt() {
+    uint8_t major;
+    uint32_t value = readHead(major);
+    TEST_ASSERT_EQUAL(0, major);
+    return value;
+  }
+
+  int32_t readInt() {
+    uint8_t major;
+    uint32_t value = readHead(major);
+    TEST_ASSERT_TRUE(major <= 1);
+    return major == 0 ? (int32_t)value : -1 - (int32_t)value;
+  }
+
+  uint32_t readMap() {
+    uint8_t major;
+    uint32_t entries = readHead(major);
+    TEST_ASSERT_EQUAL(5, major);
+    return entries;
+  }
+
+  // an integer, a decimal fraction or null (NAN)
+  float readNumber() {
+    uint8_t major;
+    size_t start = _pos;
+    uint32_t value = readHead(major);
+    if (major == 7) {
+      TEST_ASSERT_EQUAL(22, value);
+      return NAN;
+    }
+    if (major != 6) {
+      _pos = start;
+      return readInt();
+    }
+    TEST_ASSERT_EQUAL(4, value);
+    TEST_ASSERT_EQUAL(2, readHead(major));
+    TEST_ASSERT_EQUAL(4, major);
+    int32_t exponent = readInt();
+    int32_t mantissa = readInt();
+    return mantissa * powf(10, exponent);
+  }
+};
+
+static JsonVariant dataId = 42;
+static StaticJsonBuffer<JSON_ARRAY_SIZE(SENSOR_COUNT)> jsonBuffer;
+
+static void measure(SensorReadings &readings) {
+  readings.add(SENSOR_BME280_TEMP, 23.456f);
+  readings.add(SENSOR_BME280_HYGRO, 45.1f);
+  readings.add(SENSOR_BME280_BARO, 1013.25f);
+  readings.add(SENSOR_BME280_DEW, -3.75f);
+  readings.add(SENSOR_VCC, 3.3f);
+  readings.time = 1700000000;
+}
+
+static void precision(uint8_t decimals[SENSOR_COUNT]) {
+  memset(decimals, VALUES_DECIMALS, SENSOR_COUNT);
+  decimals[SENSOR_BME280_TEMP] = 1;
+  decimals[SENSOR_BME280_BARO] = 0;
+  decimals[SENSOR_VCC] = 3;
+}
+
+void test_payload_round_trip(void) {
+  SensorReadings readings;
+  measure(readings);
+  readings.add(SENSOR_BME280_ALTI, NAN);
+  uint8_t decimals[SENSOR_COUNT];
+  precision(decimals);
+  uint16_t telemetry[PHASE_COUNT] = {0};
+  telemetry[PHASE_BOOT] = 85;
+  telemetry[PHASE_WIFI] = 1234;
+
+  uint8_t payload[MAX_CBOR_PAYLOAD_SIZE];
+  size_t size = encodeCborPayload(payload, sizeof(payload), dataId, readings,
+                                  decimals, telemetry);
+  TEST_ASSERT_TRUE(size > 0);
+
+  CborReader cbor(payload, size);
+  TEST_ASSERT_EQUAL(4, cbor.readMap());
+  TEST_ASSERT_EQUAL(CBOR_KEY_DATA_ID, cbor.readUInt());
+  TEST_ASSERT_EQUAL(42, cbor.readInt());
+
+  TEST_ASSERT_EQUAL(CBOR_KEY_VALUES, cbor.readUInt());
+  TEST_ASSERT_EQUAL(readings.count, cbor.readMap());
+  for (uint8_t i = 0; i < readings.count; i++) {
+    uint8_t id = readings.ids[i];
+    TEST_ASSERT_EQUAL(id, cbor.readUInt());
+    float value = cbor.readNumber();
+    if (isnan(readings.values[i])) {
+      TEST_ASSERT_TRUE(isnan(value));
+    } else {
+      // rounded to the sensor's precision
+      TEST_ASSERT_FLOAT_WITHIN(0.5f * powf(10, -decimals[id]) + 1e-4f,
+                               readings.values[i], value);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(CBOR_KEY_TIME, cbor.readUInt());
+  TEST_ASSERT_EQUAL(1700000000, cbor.readUInt());
+
+  TEST_ASSERT_EQUAL(CBOR_KEY_TELEMETRY, cbor.readUInt());
+  TEST_ASSERT_EQUAL(2, cbor.readMap());
+  TEST_ASSERT_EQUAL(PHASE_BOOT, cbor.readUInt());
+  TEST_ASSERT_EQUAL(85, cbor.readUInt());
+  TEST_ASSERT_EQUAL(PHASE_WIFI, cbor.readUInt());
+  TEST_ASSERT_EQUAL(1234, cbor.readUInt());
+  TEST_ASSERT_TRUE(cbor.atEnd());
+}
+
+static double secondsPer(clock_t start, uint32_t runs) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC / runs;
+}
+
+// the same readings as JSON from the payload template and as CBOR
+void test_smaller_than_json(void) {
+  SensorReadings readings;
+  measure(readings);
+  uint8_t decimals[SENSOR_COUNT];
+  precision(decimals);
+
+  jsonBuffer.clear();
+  JsonArray &active = jsonBuffer.createArray();
+  for (uint8_t i = 0; i < readings.count; i++) {
+    active.add(sensorName(readings.ids[i]));
+  }
+  PayloadTemplate payloadTemplate;
+  TEST_ASSERT_TRUE(payloadTemplate.build(dataId, active, decimals));
+
+  const uint32_t runs = 20000;
+  char json[MAX_JSON_PAYLOAD_SIZE];
+  size_t jsonSize = 0;
+  clock_t start = clock();
+  for (uint32_t i = 0; i < runs; i++) {
+    jsonSize = payloadTemplate.render(readings, json, sizeof(json));
+  }
+  double jsonSeconds = secondsPer(start, runs);
+
+  uint8_t cbor[MAX_CBOR_PAYLOAD_SIZE];
+  size_t cborSize = 0;
+  start = clock();
+  for (uint32_t i = 0; i < runs; i++) {
+    cborSize =
+        encodeCborPayload(cbor, sizeof(cbor), dataId, readings, decimals);
+  }
+  double cborSeconds = secondsPer(start, runs);
+
+  char report[96];
+  snprintf(report, sizeof(report),
+           "JSON %u bytes in %.2f us, CBOR %u bytes in %.2f us",
+           (unsigned)jsonSize, jsonSeconds * 1e6, (unsigned)cborSize,
+           cborSeconds * 1e6);
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_TRUE(jsonSize > 0 && cborSize > 0);
+  // integer keys and binary numbers, less than half of the JSON
+  TEST_ASSERT_TRUE(2 * cborSize < jsonSize);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_integer_heads);
+  RUN_TEST(test_negative_integers);
+  RUN_TEST(test_containers_and_text);
+  RUN_TEST(test_decimal_fraction);
+  RUN_TEST(test_overflow);
+  RUN_TEST(test_payload_round_trip);
+  RUN_TEST(test_smaller_than_json);
+  return UNITY_END();
+}
@@ -0,0 +1,95 @@
+// the library as a whole needs the ESP8266 core, only the unit under test
+// is built on the host
+#include "CoapClient.cpp"
+#include "FakeUdp.h"
+#include <unity.h>
+
+static FakeUdp udp;
+static char response[64];
+
+void setUp(void) { udp.reset(); }
+void tearDown(void) {}
+
+static int post(CoapClient &coap, const char *query, const char *etag) {
+  return coap.post("iod.example", 5683, "n/abc/v", query, COAP_CONTENT_JSON,
+                   etag, (const uint8_t *)"{}", 2, response,
+                   sizeof(response));
+}
+
+// the request behind the random token
+static void assertRequest(const uint8_t *header, const uint8_t *options,
+                          size_t optionsLength) {
+  TEST_ASSERT_EQUAL(4 + 4 + optionsLength, udp.sentLength);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(header, udp.sent, 4);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(options, udp.sent + 8, optionsLength);
+}
+
+void test_confirmable_post(void) {
+  udp.responseCode = 0x44; // 2.04 Changed
+  CoapClient coap(udp, 0x1234);
+  TEST_ASSERT_EQUAL(204, post(coap, "auth=x", NULL));
+  TEST_ASSERT_EQUAL_HEX16(0x1235, coap.messageId());
+
+  const uint8_t header[] = {0x44, 0x02, 0x12, 0x34}; // CON POST, 4 byte token
+  const uint8_t options[] = {0xb1, 'n',                 // Uri-Path
+                             0x03, 'a', 'b', 'c',       // Uri-Path
+                             0x01, 'v',                 // Uri-Path
+                             0x11, 50,                  // Content-Format
+                             0x36, 'a', 'u', 't', 'h', '=', 'x', // Uri-Query
+                             0xff, '{', '}'};
+  assertRequest(header, options, sizeof(options));
+}
+
+void test_etag_comes_first(void) {
+  udp.responseCode = 0x44;
+  CoapClient coap(udp, 1);
+  post(coap, NULL, "ab");
+
+  const uint8_t header[] = {0x44, 0x02, 0x00, 0x01};
+  const uint8_t options[] = {0x42, 'a', 'b', // ETag
+                             0x71, 'n',      // Uri-Path, delta 7
+                             0x03, 'a', 'b', 'c', 0x01, 'v', 0x11, 50,
+                             0xff, '{', '}'};
+  assertRequest(header, options, sizeof(options));
+}
+
+void test_extended_option_length(void) {
+  udp.responseCode = 0x44;
+  CoapClient coap(udp, 1);
+  post(coap, "auth=0123456789abcde", NULL); // 20 bytes
+
+  // Uri-Query: delta 3, length 13 + 7
+  const uint8_t *query = udp.sent + 8 + 2 + 4 + 2 + 2;
+  TEST_ASSERT_EQUAL_HEX8(0x3d, query[0]);
+  TEST_ASSERT_EQUAL_HEX8(0x07, query[1]);
+}
+
+void test_response_payload_and_etag(void) {
+  const uint8_t etag[] = {0x42, 'x', 'y'};
+  udp.responseCode = 0x45; // 2.05 Content
+  udp.responseOptions = etag;
+  udp.responseOptionsLength = sizeof(etag);
+  udp.responsePayload = "{\"a\":1}";
+  CoapClient coap(udp, 1);
+  TEST_ASSERT_EQUAL(205, post(coap, NULL, NULL));
+  TEST_ASSERT_EQUAL_STRING("xy", coap.etag());
+  TEST_ASSERT_EQUAL_STRING("{\"a\":1}", response);
+  TEST_ASSERT_EQUAL(7, coap.payloadLength());
+}
+
+void test_retransmits_until_timeout(void) {
+  CoapClient coap(udp, 1);
+  coap.setRetransmits(2);
+  TEST_ASSERT_EQUAL(COAP_ERROR_TIMEOUT, post(coap, NULL, NULL));
+  TEST_ASSERT_EQUAL(3, udp.packets);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_confirmable_post);
+  RUN_TEST(test_etag_comes_first);
+  RUN_TEST(test_extended_option_length);
+  RUN_TEST(test_response_payload_and_etag);
+  RUN_TEST(test_retransmits_until_timeout);
+  return UNITY_END();
+}
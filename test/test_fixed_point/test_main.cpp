@@ -0,0 +1,56 @@
+// the library as a whole needs the ESP8266 core, only the unit under test
+// is built on the host
+#include "FixedPoint.cpp"
+#include <unity.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void assertFormats(const char *expected, float value,
+                          uint8_t decimals) {
+  char buf[MAX_FIXED_LENGTH];
+  size_t length = formatFixed(buf, value, decimals);
+  TEST_ASSERT_EQUAL_STRING(expected, buf);
+  TEST_ASSERT_EQUAL(strlen(expected), length);
+}
+
+void test_rounds_half_away_from_zero(void) {
+  assertFormats("23.46", 23.456f, 2);
+  assertFormats("-23.46", -23.456f, 2);
+  assertFormats("2", 1.5f, 0);
+  assertFormats("-2", -1.5f, 0);
+}
+
+void test_pads_decimals(void) {
+  assertFormats("0.05", 0.05f, 2);
+  assertFormats("-0.5", -0.5f, 1);
+  assertFormats("1013.250", 1013.25f, 3);
+  assertFormats("0.00", -0.004f, 2); // no "-0.00"
+}
+
+void test_clamps_decimals(void) {
+  assertFormats("1.000000", 1.0f, 9);
+}
+
+void test_nan_and_overflow(void) {
+  assertFormats("nan", NAN, 2);
+  assertFormats("ovf", INFINITY, 2);
+  assertFormats("ovf", 1e10f, 2);
+}
+
+void test_mantissa(void) {
+  int32_t mantissa;
+  TEST_ASSERT_TRUE(toFixed(23.45f, 2, mantissa));
+  TEST_ASSERT_EQUAL_INT32(2345, mantissa);
+  TEST_ASSERT_FALSE(toFixed(NAN, 2, mantissa));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_rounds_half_away_from_zero);
+  RUN_TEST(test_pads_decimals);
+  RUN_TEST(test_clamps_decimals);
+  RUN_TEST(test_nan_and_overflow);
+  RUN_TEST(test_mantissa);
+  return UNITY_END();
+}
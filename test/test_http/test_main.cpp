@@ -0,0 +1,232 @@
+// the library as a whole needs the ESP8266 core, only the unit under test
+// is built on the host
+#include "FakeClient.h"
+#include "HttpRequest.cpp"
+#include <new>
+#include <stdlib.h>
+#include <unity.h>
+
+// wake telemetry is not under test here
+void phaseStart(WakePhase phase) {}
+void phaseEnd(WakePhase phase) {}
+
+static FakeClient client;
+
+// the host heap as the ESP8266 would see it: every allocation counts and
+// the live bytes are what is missing from the free heap
+static uint32_t allocations;
+static size_t liveBytes;
+
+void *operator new(size_t size) {
+  size_t *block = (size_t *)malloc(sizeof(size_t) + size);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  allocations++;
+  liveBytes += size;
+  *block = size;
+  return block + 1;
+}
+
+void operator delete(void *p) noexcept {
+  if (p != NULL) {
+    size_t *block = (size_t *)p - 1;
+    liveBytes -= *block;
+    free(block);
+  }
+}
+
+void setUp(void) { client.reset(); }
+void tearDown(void) {}
+
+static int get(HttpRequest &request) {
+  return request.send("iod.example", 80, "GET", "/config", "dXNlcjpwYXNz",
+                      NULL, NULL, NULL, 0);
+}
+
+void test_http_date(void) {
+  TEST_ASSERT_EQUAL_UINT32(784111777,
+                           parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"));
+  TEST_ASSERT_EQUAL_UINT32(1709164800,
+                           parseHttpDate("Thu, 29 Feb 2024 00:00:00 GMT"));
+  TEST_ASSERT_EQUAL_UINT32(951868800,
+                           parseHttpDate("Wed, 01 Mar 2000 00:00:00 GMT"));
+  TEST_ASSERT_EQUAL_UINT32(0, parseHttpDate("Sunday, 06-Nov-94"));
+  TEST_ASSERT_EQUAL_UINT32(0, parseHttpDate("Sun, 06 Foo 1994 08:49:37 GMT"));
+}
+
+void test_headers(void) {
+  HttpHeaders headers;
+  headers.reset(true);
+  char length[] = "content-length: 42";
+  char etag[] = "ETag: \"abc\"";
+  char close[] = "Connection: close";
+  headers.parse(length);
+  headers.parse(etag);
+  headers.parse(close);
+  headers.complete(HTTP_OK);
+  TEST_ASSERT_EQUAL(42, headers.contentLength);
+  TEST_ASSERT_EQUAL_STRING("\"abc\"", headers.etag);
+  TEST_ASSERT_TRUE(headers.serverCloses);
+}
+
+void test_not_modified_has_no_body(void) {
+  HttpHeaders headers;
+  headers.reset(true);
+  char length[] = "Content-Length: 42";
+  headers.parse(length);
+  headers.complete(HTTP_NOT_MODIFIED);
+  TEST_ASSERT_EQUAL(0, headers.contentLength);
+}
+
+void test_retry_after_seconds(void) {
+  HttpHeaders headers;
+  headers.reset(true);
+  char retry[] = "Retry-After: 120";
+  headers.parse(retry);
+  headers.complete(503);
+  TEST_ASSERT_EQUAL_UINT32(120, headers.retryAfter);
+}
+
+void test_retry_after_date(void) {
+  HttpHeaders headers;
+  headers.reset(true);
+  char date[] = "Date: Sun, 06 Nov 1994 08:49:37 GMT";
+  char retry[] = "Retry-After: Sun, 06 Nov 1994 08:51:37 GMT";
+  headers.parse(date);
+  headers.parse(retry);
+  headers.complete(503);
+  TEST_ASSERT_EQUAL_UINT32(784111777, headers.date);
+  TEST_ASSERT_EQUAL_UINT32(120, headers.retryAfter);
+}
+
+void test_chunked_body(void) {
+  client.responses[0] = "HTTP/1.1 200 OK\r\n"
+                        "Transfer-Encoding: chunked\r\n"
+                        "\r\n"
+                        "5\r\nhello\r\n"
+                        "7\r\n, world\r\n"
+                        "0\r\n\r\n";
+  HttpRequest request(client);
+  TEST_ASSERT_EQUAL(HTTP_OK, get(request));
+
+  char body[32];
+  TEST_ASSERT_EQUAL(12, request.readBody(body, sizeof(body)));
+  TEST_ASSERT_EQUAL_STRING("hello, world", body);
+}
+
+void test_chunked_body_truncated(void) {
+  client.responses[0] = "HTTP/1.1 200 OK\r\n"
+                        "Transfer-Encoding: chunked\r\n"
+                        "\r\n"
+                        "5\r\nhello\r\n"
+                        "7\r\n, world\r\n"
+                        "0\r\n\r\n";
+  HttpRequest request(client);
+  TEST_ASSERT_EQUAL(HTTP_OK, get(request));
+
+  char body[8];
+  TEST_ASSERT_EQUAL(7, request.readBody(body, sizeof(body)));
+  TEST_ASSERT_EQUAL_STRING("hello, ", body);
+}
+
+void test_chunked_body_keeps_connection_clean(void) {
+  client.responses[0] = "HTTP/1.1 200 OK\r\n"
+                        "Transfer-Encoding: chunked\r\n"
+                        "\r\n"
+                        "2\r\n{}\r\n"
+                        "0\r\n"
+                        "Expires: 0\r\n"
+                        "\r\n"
+                        "HTTP/1.1 204 No Content\r\n\r\n";
+  HttpRequest request(client);
+  request.setKeepAlive(true);
+  TEST_ASSERT_EQUAL(HTTP_OK, get(request));
+  char body[8];
+  TEST_ASSERT_EQUAL(2, request.readBody(body, sizeof(body)));
+  request.end();
+
+  // the next response on the same connection, not the trailer
+  TEST_ASSERT_EQUAL(HTTP_NO_CONTENT, get(request));
+  TEST_ASSERT_EQUAL(1, client.connects);
+}
+
+void test_resends_when_idle_connection_was_dropped(void) {
+  client.responses[0] = "HTTP/1.1 204 No Content\r\n\r\n";
+  client.responses[1] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}";
+  HttpRequest request(client);
+  request.setKeepAlive(true);
+  TEST_ASSERT_EQUAL(HTTP_NO_CONTENT, get(request));
+  request.end();
+
+  client.dropOnWrite = true;
+  TEST_ASSERT_EQUAL(HTTP_OK, get(request));
+  TEST_ASSERT_EQUAL(2, client.connects);
+}
+
+void test_no_resend_after_timeout(void) {
+  client.responses[0] = "HTTP/1.1 204 No Content\r\n\r\n";
+  client.responses[1] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+  HttpRequest request(client);
+  request.setKeepAlive(true);
+  TEST_ASSERT_EQUAL(HTTP_NO_CONTENT, get(request));
+  request.end();
+
+  // still connected, but the server never answers
+  TEST_ASSERT_EQUAL(HTTP_ERROR_NO_RESPONSE, get(request));
+  TEST_ASSERT_EQUAL(1, client.connects);
+}
+
+// a wake's requests on one connection: config with an ETag, values with a
+// body and a chunked response
+void test_requests_do_not_allocate(void) {
+  client.responses[0] = "HTTP/1.1 304 Not Modified\r\n\r\n"
+                        "HTTP/1.1 200 OK\r\n"
+                        "Transfer-Encoding: chunked\r\n"
+                        "\r\n"
+                        "2\r\n{}\r\n"
+                        "0\r\n\r\n"
+                        "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}";
+  HttpRequest request(client);
+  request.setKeepAlive(true);
+  char body[8];
+  const uint8_t values[] = "{\"dataId\":42,\"values\":{}}";
+
+  uint32_t allocationsBefore = allocations;
+  size_t liveBytesBefore = liveBytes;
+
+  TEST_ASSERT_EQUAL(HTTP_NOT_MODIFIED,
+                    request.send("iod.example", 80, "GET", "/config",
+                                 "dXNlcjpwYXNz", "\"abc\"", NULL, NULL, 0));
+  request.end();
+  TEST_ASSERT_EQUAL(HTTP_OK,
+                    request.send("iod.example", 80, "POST", "/values",
+                                 "dXNlcjpwYXNz", NULL, "application/json",
+                                 values, sizeof(values) - 1));
+  TEST_ASSERT_EQUAL(2, request.readBody(body, sizeof(body)));
+  request.end();
+  TEST_ASSERT_EQUAL(HTTP_OK, get(request));
+  TEST_ASSERT_EQUAL(2, request.readBody(body, sizeof(body)));
+  request.end();
+
+  // nothing taken from the heap, so nothing left to fragment it
+  TEST_ASSERT_EQUAL(allocationsBefore, allocations);
+  TEST_ASSERT_EQUAL(liveBytesBefore, liveBytes);
+  TEST_ASSERT_EQUAL(1, client.connects);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_http_date);
+  RUN_TEST(test_headers);
+  RUN_TEST(test_not_modified_has_no_body);
+  RUN_TEST(test_retry_after_seconds);
+  RUN_TEST(test_retry_after_date);
+  RUN_TEST(test_chunked_body);
+  RUN_TEST(test_chunked_body_truncated);
+  RUN_TEST(test_chunked_body_keeps_connection_clean);
+  RUN_TEST(test_resends_when_idle_connection_was_dropped);
+  RUN_TEST(test_no_resend_after_timeout);
+  RUN_TEST(test_requests_do_not_allocate);
+  return UNITY_END();
+}
@@ -0,0 +1,83 @@
+// the library as a whole needs the ESP8266 core, only the unit under test
+// is built on the host
+#include "LightSleep.cpp"
+#include <unity.h>
+
+os_timer_t *timer_list = NULL;
+
+// an RF-off wake: settling a power domain (the default 200 ms), a BME280
+// conversion and a wait too short to be worth the sleep
+static const uint32_t waits[] = {200, 10, 5};
+
+struct Charge {
+  uint32_t awakeMillis;
+  uint32_t sleptMillis;
+  uint32_t saved; // uAs, as the debug output of the wake reports it
+
+  // uAs drawn by the waits
+  uint32_t microampSeconds() {
+    return ((uint64_t)awakeMillis * ACTIVE_MICROAMPS +
+            (uint64_t)sleptMillis * LIGHT_SLEEP_MICROAMPS) /
+           1000;
+  }
+};
+
+static Charge wake(bool lightSleepAllowed) {
+  allowLightSleep(lightSleepAllowed);
+  unsigned long start = millis();
+  unsigned long long rtcStart = nativeRtcMicros();
+  uint32_t savedBefore = lightSleepSavedMicroampSeconds();
+
+  for (uint8_t i = 0; i < sizeof(waits) / sizeof(waits[0]); i++) {
+    waitMillis(waits[i]);
+  }
+
+  Charge charge;
+  charge.awakeMillis = millis() - start;
+  charge.sleptMillis =
+      (nativeRtcMicros() - rtcStart) / 1000 - charge.awakeMillis;
+  charge.saved = lightSleepSavedMicroampSeconds() - savedBefore;
+  return charge;
+}
+
+void setUp(void) { timer_list = NULL; }
+void tearDown(void) {}
+
+void test_saves_charge_per_wake(void) {
+  Charge busy = wake(false);
+  Charge sleeping = wake(true);
+
+  char report[64];
+  snprintf(report, sizeof(report), "busy %lu uAs, light sleep %lu uAs",
+           (unsigned long)busy.microampSeconds(),
+           (unsigned long)sleeping.microampSeconds());
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_EQUAL(0, busy.sleptMillis);
+  TEST_ASSERT_EQUAL(0, busy.saved);
+  // the short wait stays awake, each sleep ends with 1 ms of delay() awake
+  TEST_ASSERT_EQUAL(200 + 10, sleeping.sleptMillis);
+  TEST_ASSERT_EQUAL(5 + 2, sleeping.awakeMillis);
+  // what the wake reports is what the model saves, give or take rounding
+  TEST_ASSERT_UINT32_WITHIN(1, busy.microampSeconds() -
+                                   sleeping.microampSeconds(),
+                            sleeping.saved);
+}
+
+// a pending Ticker must neither keep the chip awake nor get lost
+void test_pending_timers_are_restored(void) {
+  os_timer_t ticker = {NULL, 0};
+  timer_list = &ticker;
+  Charge sleeping = wake(true);
+
+  TEST_ASSERT_EQUAL(200 + 10, sleeping.sleptMillis);
+  TEST_ASSERT_EQUAL_PTR(&ticker, timer_list);
+  TEST_ASSERT_NULL(ticker.timer_next);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_saves_charge_per_wake);
+  RUN_TEST(test_pending_timers_are_restored);
+  return UNITY_END();
+}
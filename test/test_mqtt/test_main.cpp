@@ -0,0 +1,176 @@
+// the library as a whole needs the ESP8266 core, only the unit under test
+// is built on the host
+#include "FakeBroker.h"
+#include "FakeClient.h"
+#include "MqttClient.cpp"
+#include <unity.h>
+
+static FakeClient client;
+static FakeBroker broker;
+
+void setUp(void) {
+  client.reset();
+  broker.reset();
+}
+void tearDown(void) {}
+
+static void serve(const uint8_t *stream, size_t length) {
+  client.responses[0] = (const char *)stream;
+  client.responseLengths[0] = length;
+}
+
+void test_connect(void) {
+  const uint8_t connack[] = {0x20, 0x02, 0x01, 0x00}; // session present
+  serve(connack, sizeof(connack));
+  MqttClient mqtt(client);
+  TEST_ASSERT_EQUAL(1, mqtt.connect("iod.example", 1883, "node", "user",
+                                    "pass", false));
+
+  const uint8_t expected[] = {0x10, 28,  0,   4,   'M', 'Q', 'T', 'T',
+                              4,    0xc0, 0,  60,  0,   4,   'n', 'o',
+                              'd',  'e', 0,   4,   'u', 's', 'e', 'r',
+                              0,    4,   'p', 'a', 's', 's'};
+  TEST_ASSERT_EQUAL(sizeof(expected), client.sentLength);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, client.sent, sizeof(expected));
+}
+
+void test_connect_refused(void) {
+  const uint8_t connack[] = {0x20, 0x02, 0x00, 0x05}; // not authorized
+  serve(connack, sizeof(connack));
+  MqttClient mqtt(client);
+  TEST_ASSERT_EQUAL(MQTT_ERROR_REFUSED,
+                    mqtt.connect("iod.example", 1883, "node", "user", "pass",
+                                 true));
+  TEST_ASSERT_EQUAL_HEX8(0xc2, client.sent[9]); // clean session
+}
+
+void test_publish(void) {
+  const uint8_t stream[] = {0x20, 0x02, 0x00, 0x00, 0x40, 0x02, 0x00, 0x07};
+  serve(stream, sizeof(stream));
+  MqttClient mqtt(client);
+  TEST_ASSERT_EQUAL(0, mqtt.connect("iod.example", 1883, "node", "user",
+                                    "pass", true));
+  size_t connectLength = client.sentLength;
+
+  TEST_ASSERT_TRUE(mqtt.publish("t", (const uint8_t *)"{}", 2, 7));
+  const uint8_t expected[] = {0x32, 7, 0, 1, 't', 0, 7, '{', '}'};
+  TEST_ASSERT_EQUAL(sizeof(expected), client.sentLength - connectLength);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, client.sent + connectLength,
+                               sizeof(expected));
+}
+
+void test_remaining_length_takes_two_bytes(void) {
+  const uint8_t stream[] = {0x20, 0x02, 0x00, 0x00, 0x40, 0x02, 0x00, 0x07};
+  serve(stream, sizeof(stream));
+  MqttClient mqtt(client);
+  mqtt.connect("iod.example", 1883, "node", "user", "pass", true);
+  size_t connectLength = client.sentLength;
+
+  uint8_t payload[200];
+  memset(payload, 'x', sizeof(payload));
+  TEST_ASSERT_TRUE(mqtt.publish("t", payload, sizeof(payload), 7));
+  // 2 + 1 + 2 + 200 = 205
+  TEST_ASSERT_EQUAL_HEX8(0xcd, client.sent[connectLength + 1]);
+  TEST_ASSERT_EQUAL_HEX8(0x01, client.sent[connectLength + 2]);
+}
+
+void test_subscribe_receives_retained_config(void) {
+  const uint8_t stream[] = {0x20, 0x02, 0x00, 0x00,                // CONNACK
+                            0x30, 0x05, 0x00, 0x01, 't', 'h', 'i', // PUBLISH
+                            0x90, 0x03, 0x00, 0x05, 0x01};         // SUBACK
+  serve(stream, sizeof(stream));
+  char message[16];
+  MqttClient mqtt(client);
+  mqtt.setMessageBuffer(message, sizeof(message));
+  mqtt.connect("iod.example", 1883, "node", "user", "pass", true);
+  size_t connectLength = client.sentLength;
+
+  TEST_ASSERT_TRUE(mqtt.subscribe("t", 5));
+  const uint8_t expected[] = {0x82, 6, 0, 5, 0, 1, 't', 1};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, client.sent + connectLength,
+                               sizeof(expected));
+  TEST_ASSERT_EQUAL(2, mqtt.messageLength());
+  TEST_ASSERT_EQUAL_STRING("hi", message);
+}
+
+void test_subscribe_failure(void) {
+  const uint8_t stream[] = {0x20, 0x02, 0x00, 0x00,
+                            0x90, 0x03, 0x00, 0x05, 0x80};
+  serve(stream, sizeof(stream));
+  MqttClient mqtt(client);
+  mqtt.connect("iod.example", 1883, "node", "user", "pass", true);
+  TEST_ASSERT_FALSE(mqtt.subscribe("t", 5));
+}
+
+// one wake the way IoDCoreClient::mqttPostValues does it: subscribe unless
+// the session still holds the subscription, publish either way
+static bool wake(MqttClient &mqtt, bool &unsubscribed, uint16_t &packetId) {
+  int session = mqtt.connect("iod.example", 1883, "node", "user", "pass",
+                             false);
+  TEST_ASSERT_TRUE(session >= 0);
+  if (session != 1 || unsubscribed) {
+    unsubscribed = !mqtt.subscribe("config/node", packetId++);
+  }
+  bool delivered =
+      mqtt.publish("values/node", (const uint8_t *)"{\"t\":21}", 8, packetId++);
+  mqtt.disconnect();
+  return delivered;
+}
+
+void test_loopback_session(void) {
+  broker.retainedTopic = "config/node";
+  broker.retainedMessage = "{\"v\":2}";
+  char message[32];
+  MqttClient mqtt(broker);
+  mqtt.setMessageBuffer(message, sizeof(message));
+  bool unsubscribed = false;
+  uint16_t packetId = 1;
+
+  TEST_ASSERT_TRUE(wake(mqtt, unsubscribed, packetId));
+  TEST_ASSERT_FALSE(unsubscribed);
+  TEST_ASSERT_EQUAL(1, broker.subscribes);
+  TEST_ASSERT_EQUAL_STRING("{\"v\":2}", message);
+  TEST_ASSERT_EQUAL(1, broker.published);
+  TEST_ASSERT_EQUAL_STRING("values/node", broker.publishedTopics[0]);
+  TEST_ASSERT_EQUAL_STRING("{\"t\":21}", broker.publishedPayloads[0]);
+
+  // the session is kept, the next wake only publishes
+  TEST_ASSERT_TRUE(wake(mqtt, unsubscribed, packetId));
+  TEST_ASSERT_EQUAL(2, broker.connects);
+  TEST_ASSERT_EQUAL(1, broker.subscribes);
+  TEST_ASSERT_EQUAL(2, broker.published);
+}
+
+void test_loopback_publishes_without_subscription(void) {
+  broker.subscribeCode = 0x80;
+  MqttClient mqtt(broker);
+  bool unsubscribed = false;
+  uint16_t packetId = 1;
+
+  TEST_ASSERT_TRUE(wake(mqtt, unsubscribed, packetId));
+  TEST_ASSERT_TRUE(unsubscribed);
+  TEST_ASSERT_FALSE(broker.subscribed);
+  TEST_ASSERT_EQUAL(1, broker.published);
+  TEST_ASSERT_EQUAL_STRING("{\"t\":21}", broker.publishedPayloads[0]);
+
+  // the session is present but without the subscription: subscribe again
+  broker.subscribeCode = 0x01;
+  TEST_ASSERT_TRUE(wake(mqtt, unsubscribed, packetId));
+  TEST_ASSERT_FALSE(unsubscribed);
+  TEST_ASSERT_TRUE(broker.subscribed);
+  TEST_ASSERT_EQUAL(2, broker.subscribes);
+  TEST_ASSERT_EQUAL(2, broker.published);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connect);
+  RUN_TEST(test_connect_refused);
+  RUN_TEST(test_publish);
+  RUN_TEST(test_remaining_length_takes_two_bytes);
+  RUN_TEST(test_subscribe_receives_retained_config);
+  RUN_TEST(test_subscribe_failure);
+  RUN_TEST(test_loopback_session);
+  RUN_TEST(test_loopback_publishes_without_subscription);
+  return UNITY_END();
+}
@@ -0,0 +1,106 @@
+// the library as a whole needs the ESP8266 core, only the units under test
+// are built on the host
+#include "CborWriter.cpp"
+#include "FixedPoint.cpp"
+#include "PayloadEncoder.cpp"
+#include "SensorReadings.cpp"
+#include "WindowStats.cpp"
+#include <time.h>
+#include <unity.h>
+
+// wake telemetry is not under test here
+const char *phaseName(uint8_t phase) { return "wifi"; }
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static JsonVariant dataId = 42;
+static StaticJsonBuffer<JSON_ARRAY_SIZE(SENSOR_COUNT)> jsonBuffer;
+static PayloadTemplate payloadTemplate;
+
+static void measure(SensorReadings &readings) {
+  readings.add(SENSOR_BME280_TEMP, 23.456f);
+  readings.add(SENSOR_BME280_HYGRO, 45.1f);
+  readings.add(SENSOR_BME280_BARO, 1013.25f);
+  readings.add(SENSOR_BME280_DEW, -3.75f);
+  readings.add(SENSOR_VCC, 3.3f);
+}
+
+static void build(SensorReadings &readings) {
+  jsonBuffer.clear();
+  JsonArray &active = jsonBuffer.createArray();
+  for (uint8_t i = 0; i < readings.count; i++) {
+    active.add(sensorName(readings.ids[i]));
+  }
+  uint8_t decimals[SENSOR_COUNT];
+  memset(decimals, VALUES_DECIMALS, SENSOR_COUNT);
+  TEST_ASSERT_TRUE(payloadTemplate.build(dataId, active, decimals));
+}
+
+// the payload as main.cpp built it before the template: a JSON DOM per
+// wake and every value through String(float), which is a dtostrf() into a
+// heap copy, here snprintf() into a copy in the buffer
+static size_t renderDom(SensorReadings &readings, char *buf,
+                        size_t capacity) {
+  DynamicJsonBuffer dom(512);
+  JsonObject &payLoad = dom.createObject();
+  payLoad.set("dataId", dataId);
+  JsonObject &values = payLoad.createNestedObject("values");
+  for (uint8_t i = 0; i < readings.count; i++) {
+    char value[MAX_FIXED_LENGTH];
+    snprintf(value, sizeof(value), "%.2f", readings.values[i]);
+    values.set(sensorName(readings.ids[i]), dom.strdup(value));
+  }
+  return payLoad.printTo(buf, capacity);
+}
+
+static double secondsPer(clock_t start, uint32_t runs) {
+  return (double)(clock() - start) / CLOCKS_PER_SEC / runs;
+}
+
+void test_same_payload_as_dom(void) {
+  SensorReadings readings;
+  measure(readings);
+  build(readings);
+
+  char expected[MAX_JSON_PAYLOAD_SIZE];
+  renderDom(readings, expected, sizeof(expected));
+  char json[MAX_JSON_PAYLOAD_SIZE];
+  size_t length = payloadTemplate.render(readings, json, sizeof(json));
+  TEST_ASSERT_EQUAL_STRING(expected, json);
+  TEST_ASSERT_EQUAL(strlen(expected), length);
+}
+
+void test_faster_than_dom(void) {
+  SensorReadings readings;
+  measure(readings);
+  build(readings);
+
+  const uint32_t runs = 20000;
+  char json[MAX_JSON_PAYLOAD_SIZE];
+  clock_t start = clock();
+  for (uint32_t i = 0; i < runs; i++) {
+    renderDom(readings, json, sizeof(json));
+  }
+  double domSeconds = secondsPer(start, runs);
+
+  start = clock();
+  for (uint32_t i = 0; i < runs; i++) {
+    payloadTemplate.render(readings, json, sizeof(json));
+  }
+  double templateSeconds = secondsPer(start, runs);
+
+  char report[64];
+  snprintf(report, sizeof(report), "DOM %.2f us, template %.2f us",
+           domSeconds * 1e6, templateSeconds * 1e6);
+  TEST_MESSAGE(report);
+
+  TEST_ASSERT_TRUE(templateSeconds < domSeconds);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_same_payload_as_dom);
+  RUN_TEST(test_faster_than_dom);
+  return UNITY_END();
+}
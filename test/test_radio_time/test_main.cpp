@@ -0,0 +1,76 @@
+// the library as a whole needs the ESP8266 core, only the units under test
+// are built on the host
+#include "CoapClient.cpp"
+#include "FakeClient.h"
+#include "FakeUdp.h"
+#include "HttpRequest.cpp"
+#include <unity.h>
+
+// wake telemetry is not under test here
+void phaseStart(WakePhase phase) {}
+void phaseEnd(WakePhase phase) {}
+
+// a round trip to the server, the radio stays on while we wait for it
+#define ROUND_TRIP 40
+
+static FakeClient client;
+static FakeUdp udp;
+static const uint8_t values[] = "{\"dataId\":42,\"values\":{\"VCC\":\"3.30\"}}";
+
+void setUp(void) {
+  client.reset();
+  udp.reset();
+  client.latency = ROUND_TRIP;
+  udp.latency = ROUND_TRIP;
+}
+void tearDown(void) {}
+
+// ms from the connect to the answer of a single upload, the radio on time
+// the transport adds to a wake
+static unsigned long httpUpload() {
+  client.responses[0] = "HTTP/1.1 204 No Content\r\n\r\n";
+  unsigned long start = millis();
+  HttpRequest request(client);
+  TEST_ASSERT_EQUAL(HTTP_NO_CONTENT,
+                    request.send("iod.example", 80, "POST", "/values",
+                                 "dXNlcjpwYXNz", NULL, "application/json",
+                                 values, sizeof(values) - 1));
+  request.end();
+  return millis() - start;
+}
+
+static unsigned long coapUpload() {
+  udp.responseCode = 0x44; // 2.04 Changed
+  char response[16];
+  unsigned long start = millis();
+  CoapClient coap(udp, 1);
+  TEST_ASSERT_EQUAL(204, coap.post("iod.example", 5683, "n/abc/v",
+                                   "auth=dXNlcjpwYXNz", COAP_CONTENT_JSON,
+                                   NULL, values, sizeof(values) - 1,
+                                   response, sizeof(response)));
+  return millis() - start;
+}
+
+void test_coap_saves_the_handshake(void) {
+  unsigned long httpMillis = httpUpload();
+  unsigned long coapMillis = coapUpload();
+
+  char report[80];
+  snprintf(report, sizeof(report),
+           "HTTP %lu ms, %u bytes; CoAP %lu ms, %u bytes", httpMillis,
+           (unsigned)client.sentLength, coapMillis,
+           (unsigned)udp.sentLength);
+  TEST_MESSAGE(report);
+
+  // the TCP handshake is one more round trip before the request
+  TEST_ASSERT_TRUE(httpMillis >= 2 * ROUND_TRIP);
+  TEST_ASSERT_TRUE(coapMillis < 2 * ROUND_TRIP);
+  TEST_ASSERT_EQUAL(1, udp.packets);
+  TEST_ASSERT_TRUE(udp.sentLength < client.sentLength);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_coap_saves_the_handshake);
+  return UNITY_END();
+}
@@ -0,0 +1,62 @@
+// the library as a whole needs the ESP8266 core, only the unit under test
+// is built on the host
+#include "RtcState.cpp"
+#include <stddef.h>
+#include <unity.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// what BearSSL keeps of a session: the id offered in the next ClientHello
+// and the master secret
+static void handshake(RtcState &state) {
+  for (uint8_t i = 0; i < RTC_TLS_SESSION_LEN; i++) {
+    state.tlsSession[i] = i * 7 + 1;
+  }
+}
+
+void test_fits_rtc_user_memory(void) {
+  TEST_ASSERT_TRUE(sizeof(RtcState) <= 512);
+  TEST_ASSERT_EQUAL(0, sizeof(RtcState) % 4);
+}
+
+// a warm wake offers the session of the last one, an abbreviated handshake
+void test_tls_session_survives_deep_sleep(void) {
+  RtcState state;
+  loadRtcState(state);
+  handshake(state);
+  saveRtcState(state);
+
+  RtcState woken;
+  TEST_ASSERT_TRUE(loadRtcState(woken));
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(state.tlsSession, woken.tlsSession,
+                               RTC_TLS_SESSION_LEN);
+}
+
+// a corrupted state must not offer a garbled session id, the wake does a
+// full handshake instead
+void test_corrupted_state_starts_fresh(void) {
+  RtcState state;
+  loadRtcState(state);
+  handshake(state);
+  saveRtcState(state);
+
+  uint32_t word;
+  uint32_t offset = offsetof(RtcState, tlsSession) / 4;
+  ESP.rtcUserMemoryRead(offset, &word, sizeof(word));
+  word ^= 1;
+  ESP.rtcUserMemoryWrite(offset, &word, sizeof(word));
+
+  RtcState woken;
+  TEST_ASSERT_FALSE(loadRtcState(woken));
+  uint8_t empty[RTC_TLS_SESSION_LEN] = {0};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(empty, woken.tlsSession, RTC_TLS_SESSION_LEN);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_fits_rtc_user_memory);
+  RUN_TEST(test_tls_session_survives_deep_sleep);
+  RUN_TEST(test_corrupted_state_starts_fresh);
+  return UNITY_END();
+}
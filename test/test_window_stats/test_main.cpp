@@ -0,0 +1,98 @@
+// the library as a whole needs the ESP8266 core, only the units under test
+// are built on the host
+#include "RingBuffer.hpp"
+#include "WindowStats.cpp"
+#include <unity.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_mean_variance_min_max(void) {
+  RunningStats stats;
+  const float values[] = {2, 4, 4, 4, 5, 5, 7, 9};
+  for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    stats.add(values[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(8, stats.count);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 5.0f, stats.mean);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5f, 32.0f / 7, stats.variance());
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, stats.minimum);
+  TEST_ASSERT_EQUAL_FLOAT(9.0f, stats.maximum);
+}
+
+void test_skips_nan(void) {
+  RunningStats stats;
+  stats.add(NAN);
+  stats.add(3.0f);
+  stats.add(NAN);
+  TEST_ASSERT_EQUAL_UINT32(1, stats.count);
+  TEST_ASSERT_EQUAL_FLOAT(3.0f, stats.mean);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, stats.variance()); // below two values
+}
+
+void test_large_offset_stays_stable(void) {
+  // the naive sum of squares loses all digits here in single precision
+  RunningStats stats;
+  for (uint16_t i = 0; i < 1000; i++) {
+    stats.add(100000.0f + (i % 2 == 0 ? 4.0f : 16.0f));
+  }
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 100010.0f, stats.mean);
+  TEST_ASSERT_FLOAT_WITHIN(0.5f, 36.036f, stats.variance());
+}
+
+void test_window_reset(void) {
+  SensorWindow window;
+  window.add(SENSOR_BME280_TEMP, 21.5f);
+  window.samples = 1;
+  window.dropped = 2;
+  window.reset();
+  TEST_ASSERT_EQUAL_UINT32(0, window.stats[SENSOR_BME280_TEMP].count);
+  TEST_ASSERT_EQUAL_UINT32(0, window.samples);
+  TEST_ASSERT_EQUAL_UINT32(0, window.dropped);
+}
+
+void test_window_queue_keeps_order(void) {
+  RingBuffer<SensorWindow, 4> windows;
+  SensorWindow window;
+  TEST_ASSERT_TRUE(windows.front() == NULL);
+
+  for (uint32_t i = 1; i <= 3; i++) {
+    window.samples = i;
+    TEST_ASSERT_TRUE(windows.push(window));
+  }
+  // holds N - 1, the uploader has fallen behind
+  window.samples = 4;
+  TEST_ASSERT_FALSE(windows.push(window));
+
+  for (uint32_t i = 1; i <= 3; i++) {
+    TEST_ASSERT_EQUAL_UINT32(i, windows.front()->samples);
+    // stays queued until it was sent
+    TEST_ASSERT_EQUAL_UINT32(i, windows.front()->samples);
+    windows.pop();
+  }
+  TEST_ASSERT_TRUE(windows.front() == NULL);
+  windows.pop(); // empty, no effect
+  TEST_ASSERT_TRUE(windows.push(window));
+  TEST_ASSERT_EQUAL_UINT32(4, windows.front()->samples);
+}
+
+void test_window_queue_wraps(void) {
+  RingBuffer<uint8_t, 4> queue;
+  for (uint8_t i = 0; i < 10; i++) {
+    TEST_ASSERT_TRUE(queue.push(i));
+    TEST_ASSERT_EQUAL(i, *queue.front());
+    queue.pop();
+  }
+  TEST_ASSERT_TRUE(queue.front() == NULL);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_mean_variance_min_max);
+  RUN_TEST(test_skips_nan);
+  RUN_TEST(test_large_offset_stays_stable);
+  RUN_TEST(test_window_reset);
+  RUN_TEST(test_window_queue_keeps_order);
+  RUN_TEST(test_window_queue_wraps);
+  return UNITY_END();
+}